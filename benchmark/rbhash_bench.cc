@@ -21,11 +21,12 @@ enum Ops {
     UPSERT,
 };
 
-void gen_nums(uint64_t start, std::vector<uint64_t>& nums,
+void gen_nums(uint64_t start, uint64_t stride, std::vector<uint64_t>& nums,
     std::default_random_engine& rng)
 {
+    // stride大于1时生成等间隔的key（如按固定步长分配的ID、时间戳）
     for (uint64_t& num : nums) {
-        num = ++start;
+        num = ++start * stride;
     }
     std::shuffle(nums.begin(), nums.end(), rng);
 }
@@ -124,6 +125,8 @@ int main(int argc, char* argv[])
     uint64_t total_ops_percentage = 70;
     uint64_t num_threads = std::thread::hardware_concurrency();
     uint64_t seed = std::random_device{}();
+    uint64_t stride = 1;
+    int mixer = 0;
 
     for (int i = 1; i < argc; i++) {
         int n;
@@ -148,6 +151,11 @@ int main(int argc, char* argv[])
             num_threads = n;
         } else if (sscanf(argv[i], "--seed=%d%c", &n, &junk) == 1) {
             seed = n;
+        } else if (sscanf(argv[i], "--stride=%d%c", &n, &junk) == 1) {
+            stride = n;
+        } else if (sscanf(argv[i], "--mixer=%d%c", &n, &junk) == 1) {
+            // 0: identity, 1: fibonacci, 2: murmur
+            mixer = n;
         } else {
             std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
             std::exit(1);
@@ -165,6 +173,7 @@ int main(int argc, char* argv[])
     const size_t total_ops = initial_capacity * total_ops_percentage / 100;
 
     rbhash::map<uint64_t, uint64_t> tbl(init_hashpower);
+    tbl.mixer(static_cast<rbhash::hash_mixer>(mixer));
     std::default_random_engine di(seed);
 
     std::array<Ops, 100> op_mix;
@@ -196,7 +205,7 @@ int main(int argc, char* argv[])
 
     for (size_t i = 0; i < num_threads; ++i) {
         nums[i].resize(insert_keys_per_thread);
-        gen_nums(i * insert_keys_per_thread, nums[i], di);
+        gen_nums(i * insert_keys_per_thread, stride, nums[i], di);
     }
 
     std::cout << "Generate test data done\n";
@@ -237,7 +246,9 @@ int main(int argc, char* argv[])
               << "insert: " << insert_percentage << "%, "
               << "erase: " << erase_percentage << "%, "
               << "update: " << update_percentage << "%, "
-              << "upsert: " << upsert_percentage << "%\n"
+              << "upsert: " << upsert_percentage << "%, "
+              << "stride: " << stride << ", "
+              << "mixer: " << mixer << "\n"
               << "End mixing: total ops: " << total_ops << ", seed: " << seed
               << ", num_threads: " << num_threads
               << ", elapse: " << seconds_elapsed
@@ -18,6 +18,15 @@ printf "\nrun once:\n"
 ../build/benchmark/rhash_bench --inserts=100  --init-size=4 --total-ops=13107200 --num-threads=8
 ../build/benchmark/rhash_bench --reads=80  --inserts=20 --init-size=10 --total-ops=4096000 --num-threads=8
 
+# strided keys: identity vs fibonacci vs murmur mixer
+printf "\nstrided keys:\n"
+for stride in 1 64 4096; do
+    for mixer in 0 1 2; do
+        ../build/benchmark/rhash_bench --reads=0 --inserts=100 --init-size=20 --stride="$stride" --mixer="$mixer" --num-threads=8
+        ../build/benchmark/rhash_bench --reads=80 --erases=10 --inserts=10 --prefill=50 --init-size=20 --stride="$stride" --mixer="$mixer" --num-threads=8
+    done
+done
+
 # scalability
 printf "\nscalability:\n"
 # 100% reads
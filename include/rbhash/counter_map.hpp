@@ -0,0 +1,605 @@
+// Copyright (c) 2020 The rbhash Authors. All rights reserved.
+
+#pragma once
+
+#include <stdexcept>
+
+#include "rbhash.hpp"
+
+namespace rbhash {
+
+/**
+ * @brief
+ * 整数key、算术类型value的并发计数哈希表：已经存在的key直接在slot上原子累加，不获取自旋锁
+ *
+ * @details
+ * 与int_map相同，使用保留的key值（哨兵）标记空slot和墓碑，slot中的key和value都是原子变量。
+ *          fetch_add()先不加锁地线性探测，找到key之后直接对value执行原子加；只有key不存在
+ *          （首次插入）时才获取key所在slot的自旋锁。扩容和清空使用新的slot数组并锁住所有自旋锁，
+ *          同时把扩容计数（resizes_）置为奇数；迁移时使用exchange取走旧slot中的计数。
+ *          无锁的累加如果与扩容并发，等扩容完成后再把旧slot中残留的计数转移到新数组，
+ *          因此不会丢失任何一次累加。
+ *
+ * @note 为了让无锁的访问者可以安全地访问旧数组，扩容和清空之后旧的slot数组不会被立即释放，
+ *       而是保留到哈希表析构或者显式调用purge()为止（与insert_only_map的历史表相同）
+ * @note 墓碑不会被复用（否则无锁的累加可能作用到新插入的key上），只在扩容时被清除
+ * @note EmptyKey和DeletedKey不能作为普通key，使用时抛std::invalid_argument异常
+ *
+ * @tparam Key 哈希表中存储的键类型，必须是整数类型
+ * @tparam Value 计数的类型，必须是算术类型
+ * @tparam Hash 哈希函数，默认使用std::hash<Key>
+ * @tparam Allocator 自定义Allocator，默认使用std::allocator<std::pair<const
+ * Key, Value>>
+ * @tparam EmptyKey 表示空slot的key值，默认为Key的最大值
+ * @tparam DeletedKey 表示墓碑的key值，默认为Key的最大值减1
+ */
+template <typename Key, typename Value = uint64_t,
+          typename Hash = std::hash<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>,
+          Key EmptyKey = std::numeric_limits<Key>::max(),
+          Key DeletedKey = std::numeric_limits<Key>::max() - 1>
+class counter_map {
+  static_assert(std::is_integral<Key>::value &&
+                    !std::is_same<Key, bool>::value,
+                "counter_map requires integral key");
+  static_assert(std::is_arithmetic<Value>::value &&
+                    !std::is_same<Value, bool>::value,
+                "counter_map requires arithmetic value");
+  static_assert(EmptyKey != DeletedKey,
+                "counter_map requires distinct empty and deleted keys");
+
+ public:
+  /// 和标准库类似，定义key_type为Key的别名
+  using key_type = Key;
+  /// 和标准库类似，定义mapped_type为Value的别名
+  using mapped_type = Value;
+  /// 和标准库类似，定义size_type类型
+  using size_type = std::size_t;
+  /// 和标准库类似，定义allocator_type类型
+  using allocator_type = Allocator;
+  /// 定义hasher为模板参数Hash函数的别名
+  using hasher = Hash;
+
+  /**
+   * @brief 构造给定容量的counter_map，初始状态为空
+   *
+   * @param hp （hashpower）哈希表的初始容量（容量大小为2^hashpower）
+   * @param hf 哈希函数
+   */
+  explicit counter_map(size_type hp = HASHMAP_DEFAULT_HASHPOWER,
+                       const Hash& hf = Hash(),
+                       const Allocator& alloc = Allocator())
+      : hash_fn_(hf),
+        mixer_(hash_mixer::fibonacci),
+        slot_allocator_(alloc),
+        array_allocator_(alloc),
+        resizes_(0),
+        locks_(default_num_locks()) {
+    current_.store(create_array(hp, nullptr), std::memory_order_release);
+  }
+
+  /**
+   * @brief counter_map不支持拷贝和移动
+   */
+  counter_map(counter_map const&) = delete;
+  counter_map& operator=(counter_map const&) = delete;
+
+  /**
+   * @brief 析构函数，释放当前以及所有历史的slot数组
+   */
+  ~counter_map() {
+    slot_array* a = current_.load(std::memory_order_acquire);
+    while (a != nullptr) {
+      slot_array* prev = a->prev;
+      destroy_array(a);
+      a = prev;
+    }
+  }
+
+  /// 空slot使用的key值
+  static constexpr key_type empty_key() { return EmptyKey; }
+
+  /// 墓碑使用的key值
+  static constexpr key_type deleted_key() { return DeletedKey; }
+
+  /// 获取哈希函数
+  hasher hash_function() const { return hash_fn_; }
+
+  /// 获取hashpower
+  size_type hashpower() const {
+    return current_.load(std::memory_order_acquire)->hashpower;
+  }
+
+  /// 获取slot的数量
+  size_type bucket_count() const { return hashsize(hashpower()); }
+
+  /// 获取哈希表的容量
+  size_type capacity() const { return bucket_count(); }
+
+  /// 获取哈希表的当前大小（并发修改时为近似值）
+  size_type size() const {
+    counter_type s = 0;
+    for (const spinlock_t& lock : locks_) {
+      s += lock.elem_counter();
+    }
+    assert(s >= 0);
+    return static_cast<size_type>(s);
+  }
+
+  /// 判断哈希表当前是否为空
+  bool empty() const { return size() == 0; }
+
+  /// 获取哈希表的负载情况
+  double load_factor() const {
+    return static_cast<double>(size()) / static_cast<double>(capacity());
+  }
+
+  /// 估算哈希表占用内存大小（包括尚未释放的历史数组），字节数
+  size_type footprint() const {
+    size_type n = sizeof(spinlock_t) * locks_.size();
+    for (const slot_array* a = current_.load(std::memory_order_acquire);
+         a != nullptr; a = a->prev) {
+      n += sizeof(slot_array) + sizeof(slot) * hashsize(a->hashpower);
+    }
+    return n;
+  }
+
+  /**
+   * @brief 设置对哈希函数结果的混合策略，哈希表非空时按照新的策略重新放置所有元素
+   * @note 非线程安全，必须在哈希表被多个线程共享之前调用
+   */
+  void mixer(hash_mixer m) {
+    auto all_locks_manager = lock_all();
+    if (m == mixer_) return;
+    mixer_ = m;
+    rebuild(hashpower(), true);
+  }
+
+  /// 获取哈希表当前使用的混合策略
+  hash_mixer mixer() const { return mixer_; }
+
+  /**
+   * @brief 将key的计数增加delta，key不存在时以delta作为初始值插入
+   *
+   * @return mapped_type 增加之前的计数，key不存在时为0
+   * @throw std::invalid_argument key等于EmptyKey或DeletedKey
+   * @note key已经存在时不获取任何锁，只执行一次原子加
+   */
+  mapped_type fetch_add(key_type key, mapped_type delta) {
+    if (is_reserved(key)) {
+      throw std::invalid_argument("reserved key");
+    }
+    const uint64_t epoch = resizes_.load();
+    if ((epoch & 1) == 0) {
+      slot_array* a = current_.load(std::memory_order_acquire);
+      slot* s = probe(*a, key);
+      if (s != nullptr) {
+        const mapped_type prev = atomic_add(s->value, delta);
+        if (resizes_.load() != epoch) {
+          migrate_residue(a, s, key);
+        }
+        return prev;
+      }
+    }
+    return locked_add(key, delta);
+  }
+
+  /// 将key的计数减少delta，其余与fetch_add()相同
+  mapped_type fetch_sub(key_type key, mapped_type delta) {
+    return fetch_add(key, static_cast<mapped_type>(-delta));
+  }
+
+  /**
+   * @brief key不存在时以val作为初始计数插入
+   *
+   * @return true 插入成功
+   * @return false key已经存在，计数不变
+   */
+  bool insert(key_type key, mapped_type val) {
+    if (is_reserved(key)) {
+      throw std::invalid_argument("reserved key");
+    }
+    slot* s = nullptr;
+    LockManager lock = insert_slot(key, s);
+    if (s->key.load(std::memory_order_relaxed) == key) {
+      return false;
+    }
+    publish(s, key, val);
+    ++lock->elem_counter();
+    return true;
+  }
+
+  /**
+   * @brief 查找key的当前计数
+   *
+   * @return true key存在于哈希表中
+   * @return false key不在哈希表中
+   * @note 不与扩容并发时不获取任何锁；否则等待扩容完成
+   */
+  bool find(key_type key, mapped_type& val) const {
+    if (is_reserved(key)) {
+      return false;
+    }
+    while (true) {
+      const uint64_t epoch = resizes_.load();
+      if ((epoch & 1) == 0) {
+        const slot* s = probe(*current_.load(std::memory_order_acquire), key);
+        const mapped_type v =
+            s != nullptr ? s->value.load() : mapped_type();
+        if (resizes_.load() == epoch) {
+          if (s != nullptr) {
+            val = v;
+          }
+          return s != nullptr;
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  /**
+   * @brief 查找key的当前计数
+   * @note 如果key不存在表中，则会抛std::out_of_range异常
+   */
+  mapped_type find(key_type key) const {
+    mapped_type val = mapped_type();
+    if (!find(key, val)) {
+      throw std::out_of_range("key not found");
+    }
+    return val;
+  }
+
+  /// 判断key是否存在于哈希表中
+  bool contains(key_type key) const {
+    mapped_type val;
+    return find(key, val);
+  }
+
+  /**
+   * @brief 删除key，slot变为墓碑
+   *
+   * @return true 删除成功
+   * @return false key不在哈希表中
+   * @note 与删除并发的无锁累加可能被丢弃，相当于发生在删除之前
+   */
+  bool erase(key_type key) {
+    if (is_reserved(key)) {
+      return false;
+    }
+    slot_array* a = current_.load(std::memory_order_acquire);
+    size_type ind = home_index(a->hashpower, key), probes = 0;
+    while (true) {
+      LockManager lock = lock_slot(a, ind, probes, key);
+      slot& s = a->slots[ind];
+      const key_type k = s.key.load(std::memory_order_relaxed);
+      if (k == key) {
+        s.key.store(DeletedKey, std::memory_order_release);
+        --lock->elem_counter();
+        return true;
+      } else if (k == EmptyKey || ++probes >= hashsize(a->hashpower)) {
+        return false;
+      }
+      ind = index_hash(a->hashpower, ind + 1);
+    }
+  }
+
+  /// 哈希表reserve接口，扩容直到可以容纳n个key，不会缩容
+  void reserve(size_type n) {
+    auto all_locks_manager = lock_all();
+    size_type hp = hashpower();
+    while (hashsize(hp) < n) {
+      ++hp;
+    }
+    if (hp != hashpower()) {
+      rebuild(hp, true);
+    }
+  }
+
+  /// 清空哈希表中的所有元素，换用一个新的空slot数组
+  void clear() {
+    auto all_locks_manager = lock_all();
+    rebuild(hashpower(), false);
+  }
+
+  /**
+   * @brief 释放扩容和清空之后保留的历史slot数组
+   * @note 非线程安全，调用时不能有其他线程正在访问哈希表
+   */
+  void purge() {
+    slot_array* a = current_.load(std::memory_order_acquire);
+    slot_array* prev = a->prev;
+    a->prev = nullptr;
+    while (prev != nullptr) {
+      slot_array* next = prev->prev;
+      destroy_array(prev);
+      prev = next;
+    }
+  }
+
+ private:
+  /// 保存一个计数的slot，key的取值同时表示slot的状态
+  struct slot {
+    std::atomic<key_type> key;
+    std::atomic<mapped_type> value;
+  };
+
+  /// slot数组，扩容或清空时整体替换，旧数组通过prev链接
+  struct slot_array {
+    size_type hashpower;
+    slot* slots;
+    slot_array* prev;
+  };
+
+  template <typename U>
+  using rebind_alloc =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<U>;
+
+  /// 自旋锁集合类型，自旋锁数目固定，不随扩容变化
+  using locks_t = std::vector<spinlock_t, rebind_alloc<spinlock_t>>;
+
+  struct LockDeleter {
+    void operator()(spinlock_t* l) const { l->unlock(); }
+  };
+
+  /// spinlock_t的智能指针定义
+  using LockManager = std::unique_ptr<spinlock_t, LockDeleter>;
+
+  struct AllUnlocker {
+    void operator()(counter_map* m) const {
+      for (spinlock_t& lock : m->locks_) {
+        lock.unlock();
+      }
+    }
+  };
+
+  /// 持有所有自旋锁的智能指针
+  using AllLocksManager = std::unique_ptr<counter_map, AllUnlocker>;
+
+  static inline size_type hashsize(const size_type hp) {
+    return size_type(1) << hp;
+  }
+
+  static inline size_type hashmask(const size_type hp) {
+    return hashsize(hp) - 1;
+  }
+
+  static inline size_type index_hash(const size_type hp, const size_type hv) {
+    return hv & hashmask(hp);
+  }
+
+  static bool is_reserved(key_type key) {
+    return key == EmptyKey || key == DeletedKey;
+  }
+
+  /// 自旋锁数目与map的默认值相同（2的幂）
+  static size_type default_num_locks() {
+    const size_type cores =
+        std::max(1U, std::thread::hardware_concurrency());
+    size_type n = 1;
+    while (n < cores * HASHMAP_LOCKS_PER_CORE && n < (1UL << 16)) {
+      n <<= 1;
+    }
+    return n;
+  }
+
+  /// 整数计数使用fetch_add
+  static mapped_type atomic_add(std::atomic<mapped_type>& v, mapped_type delta,
+                                std::true_type) {
+    return v.fetch_add(delta);
+  }
+
+  /// 浮点计数没有fetch_add，使用CAS循环
+  static mapped_type atomic_add(std::atomic<mapped_type>& v, mapped_type delta,
+                                std::false_type) {
+    mapped_type prev = v.load(std::memory_order_relaxed);
+    while (!v.compare_exchange_weak(prev, prev + delta)) {
+    }
+    return prev;
+  }
+
+  static mapped_type atomic_add(std::atomic<mapped_type>& v,
+                                mapped_type delta) {
+    return atomic_add(v, delta, std::is_integral<mapped_type>());
+  }
+
+  size_type home_index(const size_type hp, key_type key) const {
+    return index_hash(hp, static_cast<size_type>(mix_hash(
+                              mixer_, static_cast<uint64_t>(hash_fn_(key)))));
+  }
+
+  spinlock_t& lock_of(const size_type ind) const {
+    return locks_[ind & (locks_.size() - 1)];
+  }
+
+  slot_array* create_array(size_type hp, slot_array* prev) {
+    slot* slots = slot_allocator_.allocate(hashsize(hp));
+    for (size_type i = 0; i < hashsize(hp); ++i) {
+      std::allocator_traits<rebind_alloc<slot>>::construct(slot_allocator_,
+                                                            &slots[i]);
+      slots[i].key.store(EmptyKey, std::memory_order_relaxed);
+      slots[i].value.store(mapped_type(), std::memory_order_relaxed);
+    }
+    slot_array* a = array_allocator_.allocate(1);
+    a->hashpower = hp;
+    a->slots = slots;
+    a->prev = prev;
+    return a;
+  }
+
+  void destroy_array(slot_array* a) noexcept {
+    for (size_type i = 0; i < hashsize(a->hashpower); ++i) {
+      std::allocator_traits<rebind_alloc<slot>>::destroy(slot_allocator_,
+                                                          &a->slots[i]);
+    }
+    slot_allocator_.deallocate(a->slots, hashsize(a->hashpower));
+    array_allocator_.deallocate(a, 1);
+  }
+
+  /// 无锁探测key所在的slot，key不存在时返回nullptr
+  slot* probe(const slot_array& a, key_type key) const {
+    size_type ind = home_index(a.hashpower, key);
+    for (size_type probes = 0; probes < hashsize(a.hashpower); ++probes) {
+      slot& s = a.slots[ind];
+      const key_type k = s.key.load(std::memory_order_acquire);
+      if (k == key) {
+        return &s;
+      } else if (k == EmptyKey) {
+        return nullptr;
+      }
+      ind = index_hash(a.hashpower, ind + 1);
+    }
+    return nullptr;
+  }
+
+  /// 先写入value，再以release语义写入key，使无锁的探测看到完整的slot
+  static void publish(slot* s, key_type key, mapped_type val) {
+    s->value.store(val, std::memory_order_relaxed);
+    s->key.store(key, std::memory_order_release);
+  }
+
+  /**
+   * @brief 对旧数组a中的slot s执行的累加与扩容并发，可能没有被迁移；等扩容完成之后，
+   *        取走s中残留的计数并累加到当前数组中
+   */
+  void migrate_residue(slot_array* a, slot* s, key_type key) {
+    while (resizes_.load() & 1) {
+      std::this_thread::yield();
+    }
+    if (current_.load(std::memory_order_acquire) == a ||
+        s->key.load(std::memory_order_acquire) != key) {
+      // a是扩容之后的新数组，累加不会丢失；或者key已经被删除
+      return;
+    }
+    const mapped_type rest = s->value.exchange(mapped_type());
+    if (rest != mapped_type()) {
+      locked_add(key, rest);
+    }
+  }
+
+  /// 持有key所在slot的自旋锁进行累加，key不存在时插入
+  mapped_type locked_add(key_type key, mapped_type delta) {
+    slot* s = nullptr;
+    LockManager lock = insert_slot(key, s);
+    if (s->key.load(std::memory_order_relaxed) == key) {
+      return atomic_add(s->value, delta);
+    }
+    publish(s, key, delta);
+    ++lock->elem_counter();
+    return mapped_type();
+  }
+
+  /**
+   * @brief 对ind指向的slot加锁；加锁之后发现slot数组发生了变化，则按照新的数组
+   *        重新计算key的home slot并重试
+   */
+  LockManager lock_slot(slot_array*& a, size_type& ind, size_type& probes,
+                        key_type key) const {
+    while (true) {
+      spinlock_t& lock = lock_of(ind);
+      lock.lock();
+      if (current_.load(std::memory_order_acquire) == a) {
+        return LockManager(&lock);
+      }
+      lock.unlock();
+      a = current_.load(std::memory_order_acquire);
+      ind = home_index(a->hashpower, key);
+      probes = 0;
+    }
+  }
+
+  /**
+   * @brief 查找key所在的slot或者可以插入key的空slot，探测次数超过hashpower时扩容
+   *
+   * @return LockManager 持有slot的自旋锁，slot通过s返回
+   */
+  LockManager insert_slot(key_type key, slot*& s) {
+    slot_array* a = current_.load(std::memory_order_acquire);
+    size_type ind = home_index(a->hashpower, key), probes = 0;
+    while (true) {
+      LockManager lock = lock_slot(a, ind, probes, key);
+      const key_type k = a->slots[ind].key.load(std::memory_order_relaxed);
+      if (k == EmptyKey || k == key) {
+        s = &a->slots[ind];
+        return lock;
+      }
+      ind = index_hash(a->hashpower, ind + 1);
+      if (++probes >= a->hashpower) {
+        lock.reset();
+        grow(a);
+        a = current_.load(std::memory_order_acquire);
+        ind = home_index(a->hashpower, key);
+        probes = 0;
+      }
+    }
+  }
+
+  /// 按照固定顺序锁住所有自旋锁，获取哈希表的唯一访问权限
+  AllLocksManager lock_all() {
+    for (spinlock_t& lock : locks_) {
+      lock.lock();
+    }
+    return AllLocksManager(this);
+  }
+
+  /// 扩容为原来的2倍；如果其他线程已经完成了扩容则直接返回
+  void grow(slot_array* orig) {
+    auto all_locks_manager = lock_all();
+    if (current_.load(std::memory_order_acquire) != orig) {
+      return;
+    }
+    rebuild(orig->hashpower + 1, true);
+  }
+
+  /**
+   * @brief 换用hashpower为new_hp的新slot数组，keep为true时迁移所有元素，同时清除所有墓碑
+   * @pre 调用者已经通过lock_all()锁住了哈希表
+   */
+  void rebuild(size_type new_hp, bool keep) {
+    resizes_.fetch_add(1);
+    slot_array* old = current_.load(std::memory_order_relaxed);
+    slot_array* fresh = create_array(new_hp, old);
+    std::vector<counter_type> counters(locks_.size(), 0);
+    for (size_type i = 0; i < hashsize(old->hashpower); ++i) {
+      slot& from = old->slots[i];
+      const key_type k = from.key.load(std::memory_order_relaxed);
+      if (is_reserved(k)) {
+        continue;
+      }
+      // exchange与无锁的累加互斥地取走计数，之后的累加由migrate_residue()转移；
+      // 清空时同样需要取走计数，否则残留的计数会被重新累加到新数组中
+      const mapped_type v = from.value.exchange(mapped_type());
+      if (!keep) {
+        continue;
+      }
+      size_type ind = home_index(new_hp, k);
+      while (fresh->slots[ind].key.load(std::memory_order_relaxed) !=
+             EmptyKey) {
+        ind = index_hash(new_hp, ind + 1);
+      }
+      publish(&fresh->slots[ind], k, v);
+      ++counters[ind & (locks_.size() - 1)];
+    }
+    current_.store(fresh, std::memory_order_release);
+    for (size_type i = 0; i < locks_.size(); ++i) {
+      locks_[i].elem_counter() = counters[i];
+    }
+    resizes_.fetch_add(1);
+  }
+
+  /// 哈希函数
+  hasher hash_fn_;
+  /// 对哈希函数结果的混合策略
+  hash_mixer mixer_;
+  /// 用于申请slot数组的allocator
+  rebind_alloc<slot> slot_allocator_;
+  /// 用于申请slot_array的allocator
+  rebind_alloc<slot_array> array_allocator_;
+  /// 当前的slot数组
+  std::atomic<slot_array*> current_;
+  /// 扩容或清空的次数乘以2，正在扩容时为奇数
+  std::atomic<uint64_t> resizes_;
+  /// 按照slot索引交错分配的自旋锁，同时记录各自负责的元素个数
+  mutable locks_t locks_;
+};
+
+}  // namespace rbhash
@@ -0,0 +1,574 @@
+// Copyright (c) 2020 The rbhash Authors. All rights reserved.
+
+#pragma once
+
+#include "rbhash.hpp"
+
+namespace rbhash {
+
+/**
+ * @brief
+ * 只插入不删除（insert-only）的无锁并发哈希表，适用于先批量填充、再大量读取，且从不删除元素的场景
+ *
+ * @details
+ * 每个slot带有一个原子状态字：插入时通过CAS将空slot（empty）抢占为构造中（busy），构造完成后
+ *          以release语义发布为就绪（ready）；查找只使用acquire读，不获取任何锁。
+ *          线性探测超过hashpower次时触发扩容：新表（generation）由一个线程申请，所有遇到扩容的
+ *          插入线程按块（chunk）协作迁移旧表，迁移时旧表中的空slot被封存（sealed），就绪的元素被
+ *          拷贝到新表；旧表在迁移期间对读者依然可用。
+ *
+ * @note 为了让读者无需任何同步就可以安全访问旧表，历史上的表（generation）不会被立即释放，
+ *       而是保留到哈希表析构或者显式调用purge()为止（类似map中历史自旋锁集合的处理方式）
+ * @note Key和Value必须可拷贝构造（迁移时拷贝而非移动，以保证旧表的读者看到完整的数据）
+ *
+ * @tparam Key 哈希表中存储的键类型
+ * @tparam Value 哈希表中存储的值类型
+ * @tparam Hash 哈希函数，默认使用std::hash<Key>
+ * @tparam KeyEqual 判断Key是否相等的相等函数，默认使用std::equal_to<Key>
+ * @tparam Allocator 自定义Allocator，默认使用std::allocator<std::pair<const
+ * Key, Value>>
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>>
+class insert_only_map {
+ private:
+  using traits_ =
+      typename std::allocator_traits<Allocator>::template rebind_traits<
+          std::pair<const Key, Value>>;
+
+ public:
+  /// 和标准库类似，定义key_type为Key的别名
+  using key_type = Key;
+  /// 和标准库类似，定义mapped_type为Value的别名
+  using mapped_type = Value;
+  /// 和标准库类似，定义value_type为键值对的聚合
+  using value_type = std::pair<const Key, Value>;
+  /// 和标准库类似，定义size_type类型
+  using size_type = std::size_t;
+  /// 和标准库类似，定义allocator_type类型
+  using allocator_type = typename traits_::allocator_type;
+  /// 定义hasher为模板参数Hash函数的别名
+  using hasher = Hash;
+  /// 定义key_equal为模板参数KeyEqual函数的别名
+  using key_equal = KeyEqual;
+
+  static_assert(std::is_copy_constructible<Key>::value &&
+                    std::is_copy_constructible<Value>::value,
+                "insert_only_map requires copy constructible key and value");
+
+  /**
+   * @brief 构造给定容量的insert_only_map，初始状态为空
+   *
+   * @param hp （hashpower）哈希表的初始容量（容量大小为2^hashpower）
+   * @param hf 哈希函数
+   * @param eq_f 相等函数，用于判断key值是否相等
+   */
+  explicit insert_only_map(size_type hp = HASHMAP_DEFAULT_HASHPOWER,
+                           const Hash& hf = Hash(),
+                           const KeyEqual& eq_f = KeyEqual(),
+                           const Allocator& alloc = Allocator())
+      : hash_fn_(hf),
+        eq_fn_(eq_f),
+        allocator_(alloc),
+        slot_allocator_(allocator_),
+        generation_allocator_(allocator_),
+        counters_(default_num_counters()) {
+    current_.store(create_generation(hp, nullptr), std::memory_order_release);
+  }
+
+  /**
+   * @brief insert_only_map不支持拷贝和移动
+   */
+  insert_only_map(insert_only_map const&) = delete;
+  insert_only_map& operator=(insert_only_map const&) = delete;
+
+  /**
+   * @brief 析构函数，释放当前以及历史上所有的表
+   */
+  ~insert_only_map() {
+    generation* g = current_.load(std::memory_order_acquire);
+    while (g->next.load(std::memory_order_acquire) != nullptr) {
+      g = g->next.load(std::memory_order_acquire);
+    }
+    while (g != nullptr) {
+      generation* prev = g->prev;
+      destroy_generation(g);
+      g = prev;
+    }
+  }
+
+  /// 获取哈希函数
+  hasher hash_function() const { return hash_fn_; }
+
+  /// 获取key比较函数
+  key_equal key_eq() const { return eq_fn_; }
+
+  /// 获取hashpower
+  size_type hashpower() const {
+    return current_.load(std::memory_order_acquire)->hashpower;
+  }
+
+  /// 获取用于保存键值对的slot的数量
+  size_type bucket_count() const { return hashsize(hashpower()); }
+
+  /// 获取哈希表的容量
+  size_type capacity() const { return bucket_count(); }
+
+  /// 获取哈希表的当前大小（并发插入时为近似值）
+  size_type size() const {
+    counter_type s = 0;
+    for (const padded_counter& c : counters_) {
+      s += c.value.load(std::memory_order_relaxed);
+    }
+    assert(s >= 0);
+    return static_cast<size_type>(s);
+  }
+
+  /// 判断哈希表当前是否为空
+  bool empty() const { return size() == 0; }
+
+  /// 获取哈希表的负载情况
+  double load_factor() const {
+    return static_cast<double>(size()) / static_cast<double>(capacity());
+  }
+
+  /// 估算哈希表占用内存大小（包括尚未释放的历史表），字节数
+  size_type footprint() const {
+    size_type bytes = counters_.size() * sizeof(padded_counter);
+    generation* g = current_.load(std::memory_order_acquire);
+    while (g->next.load(std::memory_order_acquire) != nullptr) {
+      g = g->next.load(std::memory_order_acquire);
+    }
+    for (; g != nullptr; g = g->prev) {
+      bytes += sizeof(generation) + sizeof(slot) * hashsize(g->hashpower);
+    }
+    return bytes;
+  }
+
+  /**
+   * @brief Key-Value插入操作的API接口，无锁
+   *
+   * @tparam K 待插入键（Key）的类型
+   * @tparam Args 可变参模板参数，用于构造Value
+   * @param key 待插入的具体键（key）
+   * @param val 用于构造value的参数
+   * @return true 插入哈希表成功
+   * @return false key已经存在，插入失败
+   */
+  template <typename K, typename... Args>
+  bool insert(K&& key, Args&&... val) {
+    const size_type hv = hash_fn_(key);
+    while (true) {
+      generation* g = current_.load(std::memory_order_acquire);
+      size_type ind = 0;
+      const op_status status = claim_slot(g, key, hv, ind);
+      if (status == ok) {
+        slot& s = g->slots[ind];
+        try {
+          traits_::construct(allocator_, std::addressof(s.storage_kvpair()),
+                             std::piecewise_construct,
+                             std::forward_as_tuple(std::forward<K>(key)),
+                             std::forward_as_tuple(std::forward<Args>(val)...));
+        } catch (...) {
+          // 构造失败的slot作废，探测和迁移都会跳过它，不能回到empty（否则
+          // 其他线程可能在它后面插入了同一个key）
+          s.state.store(kDead, std::memory_order_release);
+          throw;
+        }
+        s.hash = hv;
+        s.state.store(kReady, std::memory_order_release);
+        counters_[ind & (counters_.size() - 1)].value.fetch_add(
+            1, std::memory_order_relaxed);
+        return true;
+      } else if (status == failure_key_duplicated) {
+        return false;
+      }
+      // 表已满或者正在扩容，协助扩容之后在新表中重试
+      grow(g);
+    }
+  }
+
+  /**
+   * @brief Key-Value查找的API接口，无锁
+   *
+   * @param key 待查找的具体键（key）值
+   * @param val 如果key在哈希表中，键key所关联的value值
+   * @return true key存在于哈希表中
+   * @return false key不在哈希表中
+   */
+  template <typename K>
+  bool find(const K& key, mapped_type& val) const {
+    return find_fn(key, [&val](const mapped_type& v) { val = v; });
+  }
+
+  /**
+   * @brief Key-Value查找的API接口，无锁
+   *
+   * @return mapped_type 在表中key所关联的value值
+   * @note 如果key不存在表中，则会抛std::out_of_range异常
+   */
+  template <typename K>
+  mapped_type find(const K& key) const {
+    const slot* s = find_slot(key, hash_fn_(key));
+    if (s == nullptr) {
+      throw std::out_of_range("key not found");
+    }
+    return s->mapped();
+  }
+
+  /// 判断key是否存在于哈希表中，无锁
+  template <typename K>
+  bool contains(const K& key) const {
+    return find_slot(key, hash_fn_(key)) != nullptr;
+  }
+
+  /**
+   * @brief 查找API的辅助函数，无锁
+   *
+   * @param key 待查找的具体键（key）
+   * @param fn 对key所关联的value进行的只读操作
+   * @return true key在哈希表中，执行fn指定的操作
+   * @return false key不在哈希表中
+   */
+  template <typename K, typename F>
+  bool find_fn(const K& key, F fn) const {
+    const slot* s = find_slot(key, hash_fn_(key));
+    if (s == nullptr) {
+      return false;
+    }
+    fn(s->mapped());
+    return true;
+  }
+
+  /// 哈希表reserve接口，协作扩容直到可以容纳n个key-value对
+  void reserve(size_type n) {
+    while (true) {
+      generation* g = current_.load(std::memory_order_acquire);
+      if (hashsize(g->hashpower) >= n) {
+        return;
+      }
+      grow(g);
+    }
+  }
+
+  /**
+   * @brief 释放扩容后遗留的历史表
+   * @note 非线程安全，调用时不能有其他线程访问哈希表
+   */
+  void purge() {
+    generation* g = current_.load(std::memory_order_acquire);
+    assert(g->next.load(std::memory_order_acquire) == nullptr);
+    generation* prev = g->prev;
+    g->prev = nullptr;
+    while (prev != nullptr) {
+      generation* p = prev->prev;
+      destroy_generation(prev);
+      prev = p;
+    }
+  }
+
+ private:
+  /// slot的状态，只会按照empty -> busy -> ready/dead或者empty -> sealed的方向变化
+  enum slot_state : uint8_t {
+    /// 空slot
+    kEmpty,
+    /// 已被某个插入线程抢占，正在构造键值对
+    kBusy,
+    /// 键值对构造完成，对读者可见
+    kReady,
+    /// 扩容迁移时被封存的空slot，不再允许插入
+    kSealed,
+    /// 构造键值对时抛出异常而作废的slot，不保存任何键值对
+    kDead
+  };
+
+  /**
+   * @brief 对哈希表进行操作的错误码，仅内部使用外部不可见
+   */
+  enum op_status {
+    /// 操作正常完成
+    ok,
+    /// Key重复（key已经存在于哈希表中）
+    failure_key_duplicated,
+    /// 探测次数超过限制，需要扩容
+    failure_table_full,
+    /// 哈希表正在扩容中
+    failure_under_expansion
+  };
+
+  /// 保存一个键值对的slot，状态字使用原子变量
+  struct slot {
+    slot() noexcept : state(kEmpty), hash(0) {}
+
+    using storage_value_type = std::pair<Key, Value>;
+
+    const value_type& kvpair() const {
+      return *static_cast<const value_type*>(
+          static_cast<const void*>(&storage_));
+    }
+    storage_value_type& storage_kvpair() {
+      return *static_cast<storage_value_type*>(static_cast<void*>(&storage_));
+    }
+    const key_type& key() const { return kvpair().first; }
+    const mapped_type& mapped() const { return kvpair().second; }
+
+    std::atomic<uint8_t> state;
+    size_type hash;
+    typename std::aligned_storage<sizeof(storage_value_type),
+                                  alignof(storage_value_type)>::type storage_;
+  };
+
+  /// 一代（generation）表，扩容时新表通过next链接到旧表之后
+  struct generation {
+    generation(size_type hp, generation* p)
+        : hashpower(hp),
+          slots(nullptr),
+          next(nullptr),
+          resizing(false),
+          cursor(0),
+          migrated(0),
+          prev(p) {}
+
+    size_type hashpower;
+    slot* slots;
+    /// 扩容得到的新表
+    std::atomic<generation*> next;
+    /// 是否已经有线程负责申请新表
+    std::atomic<bool> resizing;
+    /// 下一个待迁移块的起始位置
+    std::atomic<size_type> cursor;
+    /// 已经完成迁移的slot个数
+    std::atomic<size_type> migrated;
+    /// 上一代表，用于析构时释放
+    generation* prev;
+  };
+
+  /// 独占缓存行的元素计数器，避免插入线程之间的伪共享
+  struct alignas(64) padded_counter {
+    padded_counter() noexcept : value(0) {}
+    padded_counter(const padded_counter& other) noexcept
+        : value(other.value.load(std::memory_order_relaxed)) {}
+    std::atomic<counter_type> value;
+  };
+
+  template <typename U>
+  using rebind_alloc =
+      typename std::allocator_traits<allocator_type>::template rebind_alloc<U>;
+
+  /// 协作迁移时每个线程一次领取的slot个数
+  static constexpr size_type kMigrateChunk = 1UL << 10;
+
+  static inline size_type hashsize(const size_type hp) {
+    return size_type(1) << hp;
+  }
+
+  static inline size_type hashmask(const size_type hp) {
+    return hashsize(hp) - 1;
+  }
+
+  static inline size_type index_hash(const size_type hp, const size_type hv) {
+    return hv & hashmask(hp);
+  }
+
+  /// 计数器个数与CPU核心数相关（2的幂）
+  static size_type default_num_counters() {
+    const size_type cores =
+        std::max(1U, std::thread::hardware_concurrency());
+    size_type n = 1;
+    while (n < 4 * cores) {
+      n <<= 1;
+    }
+    return n;
+  }
+
+  generation* create_generation(size_type hp, generation* prev) {
+    generation* g = generation_allocator_.allocate(1);
+    std::allocator_traits<rebind_alloc<generation>>::construct(
+        generation_allocator_, g, hp, prev);
+    try {
+      g->slots = slot_allocator_.allocate(hashsize(hp));
+    } catch (...) {
+      std::allocator_traits<rebind_alloc<generation>>::destroy(
+          generation_allocator_, g);
+      generation_allocator_.deallocate(g, 1);
+      throw;
+    }
+    for (size_type i = 0; i < hashsize(hp); ++i) {
+      std::allocator_traits<rebind_alloc<slot>>::construct(slot_allocator_,
+                                                            &g->slots[i]);
+    }
+    return g;
+  }
+
+  void destroy_generation(generation* g) noexcept {
+    for (size_type i = 0; i < hashsize(g->hashpower); ++i) {
+      slot& s = g->slots[i];
+      if (s.state.load(std::memory_order_relaxed) == kReady) {
+        traits_::destroy(allocator_, std::addressof(s.storage_kvpair()));
+      }
+      std::allocator_traits<rebind_alloc<slot>>::destroy(slot_allocator_, &s);
+    }
+    slot_allocator_.deallocate(g->slots, hashsize(g->hashpower));
+    std::allocator_traits<rebind_alloc<generation>>::destroy(
+        generation_allocator_, g);
+    generation_allocator_.deallocate(g, 1);
+  }
+
+  /**
+   * @brief 在表g中为key抢占一个空slot
+   *
+   * @param g 当前表
+   * @param key 待插入的key
+   * @param hv key的哈希值
+   * @param ind 抢占成功时返回slot的索引
+   * @return op_status ok表示抢占成功（slot处于busy状态），其余为失败原因
+   * @note 同一个key的插入线程沿相同的探测序列前进，并在第一个空slot上竞争，
+   *       因此不会出现重复插入
+   */
+  template <typename K>
+  op_status claim_slot(generation* g, const K& key, size_type hv,
+                       size_type& ind) const {
+    const size_type hp = g->hashpower;
+    size_type probes = 0;
+    ind = index_hash(hp, hv);
+    while (true) {
+      slot& s = g->slots[ind];
+      uint8_t state = s.state.load(std::memory_order_acquire);
+      if (state == kEmpty) {
+        if (probes != 0 && probes >= hp) {
+          // 超过探测上限，没有重复的key，需要扩容
+          return failure_table_full;
+        }
+        if (s.state.compare_exchange_strong(state, kBusy,
+                                            std::memory_order_acq_rel)) {
+          return ok;
+        }
+        // 竞争失败，重新检查同一个slot
+        continue;
+      } else if (state == kBusy) {
+        // 等待其他线程构造完成，以便比较key
+        continue;
+      } else if (state == kSealed) {
+        return failure_under_expansion;
+      } else if (state == kReady && s.hash == hv && eq_fn_(s.key(), key)) {
+        return failure_key_duplicated;
+      }
+      // 超过探测上限后继续检查重复key，直到遇到空slot
+      if (++probes >= hashsize(hp)) {
+        return failure_table_full;
+      }
+      ind = index_hash(hp, ind + 1);
+    }
+  }
+
+  /// 无锁查找，跳过正在构造的slot（其插入操作尚未完成）
+  template <typename K>
+  const slot* find_slot(const K& key, size_type hv) const {
+    const generation* g = current_.load(std::memory_order_acquire);
+    const size_type hp = g->hashpower;
+    size_type ind = index_hash(hp, hv);
+    for (size_type probes = 0; probes < hashsize(hp); ++probes) {
+      const slot& s = g->slots[ind];
+      const uint8_t state = s.state.load(std::memory_order_acquire);
+      if (state == kEmpty || state == kSealed) {
+        return nullptr;
+      } else if (state == kReady && s.hash == hv && eq_fn_(s.key(), key)) {
+        return &s;
+      }
+      ind = index_hash(hp, ind + 1);
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief 扩容：申请（或等待）新表，协助迁移，最后发布新表
+   * @note 申请新表失败时清除resizing标记并抛出异常，等待的线程会接手申请
+   */
+  void grow(generation* g) {
+    generation* next;
+    while ((next = g->next.load(std::memory_order_acquire)) == nullptr) {
+      if (!g->resizing.exchange(true, std::memory_order_acq_rel)) {
+        try {
+          next = create_generation(g->hashpower + 1, g);
+        } catch (...) {
+          g->resizing.store(false, std::memory_order_release);
+          throw;
+        }
+        g->next.store(next, std::memory_order_release);
+        break;
+      }
+      std::this_thread::yield();
+    }
+
+    const size_type n = hashsize(g->hashpower);
+    size_type begin;
+    while ((begin = g->cursor.fetch_add(kMigrateChunk,
+                                        std::memory_order_relaxed)) < n) {
+      const size_type end = std::min(n, begin + kMigrateChunk);
+      for (size_type i = begin; i < end; ++i) {
+        migrate_slot(g->slots[i], next);
+      }
+      g->migrated.fetch_add(end - begin, std::memory_order_acq_rel);
+    }
+    while (g->migrated.load(std::memory_order_acquire) < n) {
+      std::this_thread::yield();
+    }
+    current_.compare_exchange_strong(g, next, std::memory_order_acq_rel);
+  }
+
+  /// 迁移旧表中的一个slot：空slot被封存，就绪的键值对被拷贝到新表，作废的slot被丢弃
+  void migrate_slot(slot& s, generation* next) {
+    while (true) {
+      uint8_t state = s.state.load(std::memory_order_acquire);
+      if (state == kDead) {
+        return;
+      } else if (state == kEmpty) {
+        if (s.state.compare_exchange_strong(state, kSealed,
+                                            std::memory_order_acq_rel)) {
+          return;
+        }
+      } else if (state == kReady) {
+        place_migrated(next, s);
+        return;
+      }
+      // busy：等待插入线程完成构造
+    }
+  }
+
+  /// 将迁移的键值对放入新表；新表容量为旧表2倍，迁移期间只有迁移线程写入，无需探测上限
+  void place_migrated(generation* next, const slot& from) {
+    const size_type hp = next->hashpower;
+    size_type ind = index_hash(hp, from.hash);
+    while (true) {
+      slot& s = next->slots[ind];
+      uint8_t state = kEmpty;
+      if (s.state.compare_exchange_strong(state, kBusy,
+                                          std::memory_order_acq_rel)) {
+        traits_::construct(allocator_, std::addressof(s.storage_kvpair()),
+                           from.kvpair());
+        s.hash = from.hash;
+        s.state.store(kReady, std::memory_order_release);
+        return;
+      }
+      ind = index_hash(hp, ind + 1);
+    }
+  }
+
+  /// 哈希函数
+  hasher hash_fn_;
+  /// 判别key是否相等的相等函数
+  key_equal eq_fn_;
+  /// 用于构造键值对的allocator
+  allocator_type allocator_;
+  /// 用于申请slot数组的allocator
+  rebind_alloc<slot> slot_allocator_;
+  /// 用于申请表结构的allocator
+  rebind_alloc<generation> generation_allocator_;
+  /// 当前对读者和插入者可见的表
+  std::atomic<generation*> current_;
+  /// 分散的元素计数器，按照slot索引选择
+  std::vector<padded_counter, rebind_alloc<padded_counter>> counters_;
+};
+
+}  // namespace rbhash
@@ -0,0 +1,580 @@
+// Copyright (c) 2020 The rbhash Authors. All rights reserved.
+
+#pragma once
+
+#include <stdexcept>
+
+#include "rbhash.hpp"
+
+namespace rbhash {
+
+/**
+ * @brief
+ * 整数key专用的并发线程安全哈希表，使用保留的key值（哨兵）标记空slot和墓碑
+ *
+ * @details
+ * 与map相同，使用线性探测法解决哈希冲突（插入时探测次数超过hashpower则扩容），并且按照
+ *          bucket交错分配自旋锁；区别在于slot中不保存occupied/deleted标志位以及哈希值：
+ *          key等于EmptyKey表示空slot，等于DeletedKey表示已删除的元素（墓碑）。
+ *          插入时不重用墓碑（否则无法排除探测序列后面已经存在相同的key），探测过长
+ *          时如果墓碑较多则按照原容量重建以回收墓碑。
+ *          uint64_t到uint64_t的slot只有16字节（map的bucket为32字节），查找时每个缓存行
+ *          可以容纳的slot数目翻倍。整数的std::hash通常是恒等函数，因此默认使用
+ *          hash_mixer::fibonacci混合哈希值
+ *
+ * @note EmptyKey和DeletedKey不能作为普通key插入，插入时抛std::invalid_argument异常
+ * @note 不保存哈希值，扩容时重新计算每个key的哈希值（对整数key开销很小）
+ *
+ * @tparam Key 哈希表中存储的键类型，必须是整数类型
+ * @tparam Value 哈希表中存储的值类型
+ * @tparam Hash 哈希函数，默认使用std::hash<Key>
+ * @tparam Allocator 自定义Allocator，默认使用std::allocator<std::pair<const
+ * Key, Value>>
+ * @tparam EmptyKey 表示空slot的key值，默认为Key的最大值
+ * @tparam DeletedKey 表示墓碑的key值，默认为Key的最大值减1
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>,
+          Key EmptyKey = std::numeric_limits<Key>::max(),
+          Key DeletedKey = std::numeric_limits<Key>::max() - 1>
+class int_map {
+  static_assert(std::is_integral<Key>::value &&
+                    !std::is_same<Key, bool>::value,
+                "int_map requires integral key");
+  static_assert(EmptyKey != DeletedKey,
+                "int_map requires distinct empty and deleted keys");
+
+ private:
+  using traits_ = typename std::allocator_traits<
+      Allocator>::template rebind_traits<Value>;
+
+ public:
+  /// 和标准库类似，定义key_type为Key的别名
+  using key_type = Key;
+  /// 和标准库类似，定义mapped_type为Value的别名
+  using mapped_type = Value;
+  /// 和标准库类似，定义size_type类型
+  using size_type = std::size_t;
+  /// 和标准库类似，定义allocator_type类型
+  using allocator_type = typename traits_::allocator_type;
+  /// 定义hasher为模板参数Hash函数的别名
+  using hasher = Hash;
+
+  /**
+   * @brief 构造给定容量的int_map，初始状态为空
+   *
+   * @param hp （hashpower）哈希表的初始容量（容量大小为2^hashpower）
+   * @param hf 哈希函数
+   */
+  explicit int_map(size_type hp = HASHMAP_DEFAULT_HASHPOWER,
+                   const Hash& hf = Hash(),
+                   const Allocator& alloc = Allocator())
+      : hash_fn_(hf),
+        mixer_(hash_mixer::fibonacci),
+        allocator_(alloc),
+        slot_allocator_(allocator_),
+        hashpower_(hp),
+        slots_(create_slots(hp)),
+        tombstones_(0),
+        version_(0),
+        locks_(default_num_locks()) {}
+
+  /**
+   * @brief int_map不支持拷贝和移动
+   */
+  int_map(int_map const&) = delete;
+  int_map& operator=(int_map const&) = delete;
+
+  /**
+   * @brief 析构函数，释放所有键值对以及slot数组
+   */
+  ~int_map() { destroy_slots(slots_, hashpower()); }
+
+  /// 空slot使用的key值
+  static constexpr key_type empty_key() { return EmptyKey; }
+
+  /// 墓碑使用的key值
+  static constexpr key_type deleted_key() { return DeletedKey; }
+
+  /// 获取哈希函数
+  hasher hash_function() const { return hash_fn_; }
+
+  /// 获取hashpower
+  size_type hashpower() const {
+    return hashpower_.load(std::memory_order_acquire);
+  }
+
+  /// 获取slot的数量
+  size_type bucket_count() const { return hashsize(hashpower()); }
+
+  /// 获取哈希表的容量
+  size_type capacity() const { return bucket_count(); }
+
+  /// 获取哈希表的当前大小（并发修改时为近似值）
+  size_type size() const {
+    counter_type s = 0;
+    for (const spinlock_t& lock : locks_) {
+      s += lock.elem_counter();
+    }
+    assert(s >= 0);
+    return static_cast<size_type>(s);
+  }
+
+  /// 判断哈希表当前是否为空
+  bool empty() const { return size() == 0; }
+
+  /// 获取哈希表的负载情况
+  double load_factor() const {
+    return static_cast<double>(size()) / static_cast<double>(capacity());
+  }
+
+  /// 返回哈希表占用的内存大小，字节数
+  size_type footprint() const {
+    return sizeof(slot) * capacity() + sizeof(spinlock_t) * locks_.size();
+  }
+
+  /**
+   * @brief 设置对哈希函数结果的混合策略，哈希表非空时按照新的策略重新放置所有元素
+   * @note 非线程安全，必须在哈希表被多个线程共享之前调用
+   */
+  void mixer(hash_mixer m) {
+    auto all_locks_manager = lock_all();
+    if (m == mixer_) return;
+    mixer_ = m;
+    rebuild(hashpower());
+  }
+
+  /// 获取哈希表当前使用的混合策略
+  hash_mixer mixer() const { return mixer_; }
+
+  /**
+   * @brief Key-Value插入操作的API接口
+   *
+   * @param key 待插入的key
+   * @param val 用于构造value的参数
+   * @return true 插入哈希表成功
+   * @return false key已经存在，插入失败
+   * @throw std::invalid_argument key等于EmptyKey或DeletedKey
+   */
+  template <typename... Args>
+  bool insert(key_type key, Args&&... val) {
+    return upsert(key, [](mapped_type&) {}, std::forward<Args>(val)...);
+  }
+
+  /**
+   * @brief key不存在时插入，存在时赋值
+   *
+   * @return true 插入了新的键值对
+   * @return false key已经存在，value被赋值为val
+   */
+  template <typename V>
+  bool insert_or_assign(key_type key, V&& val) {
+    return upsert(key, [&val](mapped_type& m) { m = std::forward<V>(val); },
+                  std::forward<V>(val));
+  }
+
+  /**
+   * @brief key已经存在时对其value执行fn，否则使用val构造value并插入
+   *
+   * @return true 插入了新的键值对
+   * @return false key已经存在，执行了fn
+   * @throw std::invalid_argument key等于EmptyKey或DeletedKey
+   */
+  template <typename F, typename... Args>
+  bool upsert(key_type key, F fn, Args&&... val) {
+    if (is_reserved(key)) {
+      throw std::invalid_argument("reserved key");
+    }
+    size_type ind = 0;
+    bool duplicated = false;
+    LockManager lock = insert_slot(key, ind, duplicated);
+    slot& s = slots_[ind];
+    if (duplicated) {
+      fn(s.mapped());
+      return false;
+    }
+    traits_::construct(allocator_, &s.mapped(), std::forward<Args>(val)...);
+    s.key = key;
+    ++lock->elem_counter();
+    return true;
+  }
+
+  /**
+   * @brief Key-Value查找的API接口
+   *
+   * @param key 待查找的key
+   * @param val 如果key在哈希表中，键key所关联的value值
+   * @return true key存在于哈希表中
+   * @return false key不在哈希表中
+   */
+  bool find(key_type key, mapped_type& val) const {
+    return find_fn(key, [&val](const mapped_type& v) { val = v; });
+  }
+
+  /**
+   * @brief Key-Value查找的API接口
+   *
+   * @return mapped_type 在表中key所关联的value值
+   * @note 如果key不存在表中，则会抛std::out_of_range异常
+   */
+  mapped_type find(key_type key) const {
+    size_type ind = 0;
+    LockManager lock = find_slot(key, ind);
+    if (!lock) {
+      throw std::out_of_range("key not found");
+    }
+    return slots_[ind].mapped();
+  }
+
+  /// 判断key是否存在于哈希表中
+  bool contains(key_type key) const {
+    size_type ind = 0;
+    return static_cast<bool>(find_slot(key, ind));
+  }
+
+  /**
+   * @brief 查找key，存在时在持有自旋锁的情况下对value执行只读操作fn
+   *
+   * @return true key在哈希表中，执行了fn
+   * @return false key不在哈希表中
+   */
+  template <typename F>
+  bool find_fn(key_type key, F fn) const {
+    size_type ind = 0;
+    LockManager lock = find_slot(key, ind);
+    if (!lock) {
+      return false;
+    }
+    fn(static_cast<const mapped_type&>(slots_[ind].mapped()));
+    return true;
+  }
+
+  /**
+   * @brief 查找key，存在时在持有自旋锁的情况下对value执行fn
+   *
+   * @return true key在哈希表中，执行了fn
+   * @return false key不在哈希表中
+   */
+  template <typename F>
+  bool update_fn(key_type key, F fn) {
+    size_type ind = 0;
+    LockManager lock = find_slot(key, ind);
+    if (!lock) {
+      return false;
+    }
+    fn(slots_[ind].mapped());
+    return true;
+  }
+
+  /// key存在时将其value更新为val
+  template <typename V>
+  bool update(key_type key, V&& val) {
+    return update_fn(key,
+                     [&val](mapped_type& m) { m = std::forward<V>(val); });
+  }
+
+  /**
+   * @brief 删除key，slot变为墓碑
+   *
+   * @return true 删除成功
+   * @return false key不在哈希表中
+   */
+  bool erase(key_type key) {
+    size_type ind = 0;
+    LockManager lock = find_slot(key, ind);
+    if (!lock) {
+      return false;
+    }
+    slot& s = slots_[ind];
+    traits_::destroy(allocator_, &s.mapped());
+    s.key = DeletedKey;
+    --lock->elem_counter();
+    tombstones_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /// 哈希表reserve接口，扩容直到可以容纳n个key-value对，不会缩容
+  void reserve(size_type n) {
+    auto all_locks_manager = lock_all();
+    size_type hp = hashpower();
+    while (hashsize(hp) < n) {
+      ++hp;
+    }
+    if (hp != hashpower()) {
+      rebuild(hp);
+    }
+  }
+
+  /// 清空哈希表中的所有元素，不释放内存
+  void clear() {
+    auto all_locks_manager = lock_all();
+    const size_type n = capacity();
+    for (size_type i = 0; i < n; ++i) {
+      slot& s = slots_[i];
+      if (!is_reserved(s.key)) {
+        traits_::destroy(allocator_, &s.mapped());
+      }
+      s.key = EmptyKey;
+    }
+    for (spinlock_t& lock : locks_) {
+      lock.elem_counter() = 0;
+    }
+    tombstones_.store(0, std::memory_order_relaxed);
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+ private:
+  /// 保存一个键值对的slot，key的取值同时表示slot的状态
+  struct slot {
+    mapped_type& mapped() {
+      return *static_cast<mapped_type*>(static_cast<void*>(&storage));
+    }
+
+    key_type key;
+    typename std::aligned_storage<sizeof(mapped_type),
+                                  alignof(mapped_type)>::type storage;
+  };
+
+  template <typename U>
+  using rebind_alloc =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<U>;
+
+  /// 自旋锁集合类型，自旋锁数目固定，不随扩容变化
+  using locks_t = std::vector<spinlock_t, rebind_alloc<spinlock_t>>;
+
+  struct LockDeleter {
+    void operator()(spinlock_t* l) const { l->unlock(); }
+  };
+
+  /// spinlock_t的智能指针定义
+  using LockManager = std::unique_ptr<spinlock_t, LockDeleter>;
+
+  struct AllUnlocker {
+    void operator()(int_map* m) const {
+      for (spinlock_t& lock : m->locks_) {
+        lock.unlock();
+      }
+    }
+  };
+
+  /// 持有所有自旋锁的智能指针
+  using AllLocksManager = std::unique_ptr<int_map, AllUnlocker>;
+
+  static inline size_type hashsize(const size_type hp) {
+    return size_type(1) << hp;
+  }
+
+  static inline size_type hashmask(const size_type hp) {
+    return hashsize(hp) - 1;
+  }
+
+  static inline size_type index_hash(const size_type hp, const size_type hv) {
+    return hv & hashmask(hp);
+  }
+
+  static bool is_reserved(key_type key) {
+    return key == EmptyKey || key == DeletedKey;
+  }
+
+  /// 自旋锁数目与map的默认值相同（2的幂）
+  static size_type default_num_locks() {
+    const size_type cores =
+        std::max(1U, std::thread::hardware_concurrency());
+    size_type n = 1;
+    while (n < cores * HASHMAP_LOCKS_PER_CORE && n < (1UL << 16)) {
+      n <<= 1;
+    }
+    return n;
+  }
+
+  size_type home_index(const size_type hp, key_type key) const {
+    return index_hash(hp, static_cast<size_type>(mix_hash(
+                              mixer_, static_cast<uint64_t>(hash_fn_(key)))));
+  }
+
+  spinlock_t& lock_of(const size_type ind) const {
+    return locks_[ind & (locks_.size() - 1)];
+  }
+
+  slot* create_slots(size_type hp) {
+    slot* slots = slot_allocator_.allocate(hashsize(hp));
+    for (size_type i = 0; i < hashsize(hp); ++i) {
+      std::allocator_traits<rebind_alloc<slot>>::construct(slot_allocator_,
+                                                            &slots[i]);
+      slots[i].key = EmptyKey;
+    }
+    return slots;
+  }
+
+  void destroy_slots(slot* slots, size_type hp) noexcept {
+    for (size_type i = 0; i < hashsize(hp); ++i) {
+      slot& s = slots[i];
+      if (!is_reserved(s.key)) {
+        traits_::destroy(allocator_, &s.mapped());
+      }
+      std::allocator_traits<rebind_alloc<slot>>::destroy(slot_allocator_, &s);
+    }
+    slot_allocator_.deallocate(slots, hashsize(hp));
+  }
+
+  /**
+   * @brief 对ind指向的slot加锁；加锁之后发现slot数组被重建或清空过（version_发生了
+   *        变化），则按照新的hashpower重新计算key的home slot并重试
+   *
+   * @note 按照原容量重建时hashpower不变但元素的位置可能前移，因此不能只比较hashpower
+   */
+  LockManager lock_slot(uint64_t& version, size_type& hp, size_type& ind,
+                        size_type& probes, key_type key) const {
+    while (true) {
+      spinlock_t& lock = lock_of(ind);
+      lock.lock();
+      if (version_.load(std::memory_order_relaxed) == version) {
+        return LockManager(&lock);
+      }
+      lock.unlock();
+      version = version_.load(std::memory_order_acquire);
+      hp = hashpower();
+      ind = home_index(hp, key);
+      probes = 0;
+    }
+  }
+
+  /**
+   * @brief 查找key所在的slot
+   *
+   * @return LockManager key存在时持有其所在slot的自旋锁，索引通过ind返回；
+   *         key不存在时为空
+   * @note 扩容时元素可能被放在离home slot超过hashpower的位置，因此查找一直进行到
+   *       遇到空slot为止
+   */
+  LockManager find_slot(key_type key, size_type& ind) const {
+    if (is_reserved(key)) {
+      return nullptr;
+    }
+    uint64_t version = version_.load(std::memory_order_acquire);
+    size_type hp = hashpower(), probes = 0;
+    ind = home_index(hp, key);
+    while (true) {
+      LockManager lock = lock_slot(version, hp, ind, probes, key);
+      const key_type k = slots_[ind].key;
+      if (k == key) {
+        return lock;
+      } else if (k == EmptyKey || ++probes >= hashsize(hp)) {
+        return nullptr;
+      }
+      ind = index_hash(hp, ind + 1);
+    }
+  }
+
+  /**
+   * @brief 查找可以插入key的空slot，探测次数超过hashpower时扩容或回收墓碑
+   *
+   * @return LockManager 持有slot的自旋锁，索引通过ind返回；key已经存在时duplicated为true
+   * @note 墓碑不会被重用：key可能位于墓碑之后，而逐个slot加锁的探测无法在持有墓碑的
+   *       自旋锁的同时确认后面不存在相同的key
+   */
+  LockManager insert_slot(key_type key, size_type& ind, bool& duplicated) {
+    uint64_t version = version_.load(std::memory_order_acquire);
+    size_type hp = hashpower(), probes = 0;
+    ind = home_index(hp, key);
+    while (true) {
+      LockManager lock = lock_slot(version, hp, ind, probes, key);
+      const key_type k = slots_[ind].key;
+      if (k == EmptyKey) {
+        duplicated = false;
+        return lock;
+      } else if (k == key) {
+        duplicated = true;
+        return lock;
+      }
+      ind = index_hash(hp, ind + 1);
+      if (++probes >= hp) {
+        lock.reset();
+        grow(version);
+        version = version_.load(std::memory_order_acquire);
+        hp = hashpower();
+        ind = home_index(hp, key);
+        probes = 0;
+      }
+    }
+  }
+
+  /// 按照固定顺序锁住所有自旋锁，获取哈希表的唯一访问权限
+  AllLocksManager lock_all() {
+    for (spinlock_t& lock : locks_) {
+      lock.lock();
+    }
+    return AllLocksManager(this);
+  }
+
+  /**
+   * @brief 扩容为原来的2倍；墓碑超过容量的1/4或者多于有效元素时只按照原容量重建
+   *        （哈希冲突严重时探测过长的原因主要是墓碑）。如果其他线程已经完成了重建则
+   *        直接返回
+   *
+   * @param orig_version 调用者探测时看到的version_
+   */
+  void grow(uint64_t orig_version) {
+    auto all_locks_manager = lock_all();
+    if (version_.load(std::memory_order_relaxed) != orig_version) {
+      return;
+    }
+    const size_type hp = hashpower();
+    const size_type tombstones = tombstones_.load(std::memory_order_relaxed);
+    const bool sparse = tombstones * 4 > hashsize(hp) || tombstones > size();
+    rebuild(sparse ? hp : hp + 1);
+  }
+
+  /**
+   * @brief 将所有元素迁移到hashpower为new_hp的新slot数组中，同时清除所有墓碑
+   * @pre 调用者已经通过lock_all()锁住了哈希表
+   */
+  void rebuild(size_type new_hp) {
+    const size_type hp = hashpower();
+    slot* fresh = create_slots(new_hp);
+    std::vector<counter_type> counters(locks_.size(), 0);
+    for (size_type i = 0; i < hashsize(hp); ++i) {
+      slot& from = slots_[i];
+      if (is_reserved(from.key)) {
+        continue;
+      }
+      size_type ind = home_index(new_hp, from.key);
+      while (fresh[ind].key != EmptyKey) {
+        ind = index_hash(new_hp, ind + 1);
+      }
+      traits_::construct(allocator_, &fresh[ind].mapped(),
+                         std::move(from.mapped()));
+      fresh[ind].key = from.key;
+      ++counters[ind & (locks_.size() - 1)];
+    }
+    destroy_slots(slots_, hp);
+    slots_ = fresh;
+    for (size_type i = 0; i < locks_.size(); ++i) {
+      locks_[i].elem_counter() = counters[i];
+    }
+    tombstones_.store(0, std::memory_order_relaxed);
+    hashpower_.store(new_hp, std::memory_order_release);
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+  /// 哈希函数
+  hasher hash_fn_;
+  /// 对哈希函数结果的混合策略
+  hash_mixer mixer_;
+  /// 用于构造value的allocator
+  allocator_type allocator_;
+  /// 用于申请slot数组的allocator
+  rebind_alloc<slot> slot_allocator_;
+  /// 当前的hashpower
+  std::atomic<size_type> hashpower_;
+  /// 当前的slot数组，只在持有对应自旋锁时访问
+  slot* slots_;
+  /// 上一次重建之后产生的墓碑个数
+  std::atomic<size_type> tombstones_;
+  /// slot数组被重建或清空的次数，加锁之后通过它判断slot的布局是否发生了变化
+  std::atomic<uint64_t> version_;
+  /// 按照slot索引交错分配的自旋锁，同时记录各自负责的元素个数
+  mutable locks_t locks_;
+};
+
+}  // namespace rbhash
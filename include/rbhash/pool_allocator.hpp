@@ -0,0 +1,379 @@
+// Copyright (c) 2020 The rbhash Authors. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace rbhash {
+
+/**
+ * @brief pool_allocator使用的进程级内存池
+ *
+ * @details
+ * 按照申请的大小分为三类：
+ *          - 小对象（不超过kMaxSmallSize字节）：按16字节划分大小级别（size class），
+ *            每个线程缓存各级别的空闲链表，缓存为空时从全局链表批量领取，全局链表为空时
+ *            从新申请的slab中切分；线程缓存过多时批量归还给全局链表，线程退出时全部归还
+ *          - 数组（不小于kMinArraySize字节，例如bucket数组）：释放时按照字节数放入回收缓存，
+ *            再次申请相同大小时直接复用，扩容、收缩、清空后重建等场景不需要重新申请内存页；
+ *            缓存的总字节数不超过max_cached_bytes()，数组按照缓存行（64字节）对齐
+ *          - 其他大小直接使用operator new
+ *
+ * @note 内存池本身不会被析构，slab在进程退出之前不会归还给系统，因此静态对象的析构
+ *       函数和main返回之后才退出的线程仍然可以使用pool_allocator
+ */
+class pool_resource {
+ public:
+  /// 小对象的最大字节数
+  static constexpr size_t kMaxSmallSize = 256;
+  /// 放入回收缓存的数组的最小字节数
+  static constexpr size_t kMinArraySize = 4096;
+  /// 支持的最大对齐字节数
+  static constexpr size_t kMaxAlign = 64;
+
+  /// 获取进程级的内存池，有意不释放，避免静态析构顺序问题
+  static pool_resource& instance() {
+    static pool_resource* const pool = new pool_resource;
+    return *pool;
+  }
+
+  pool_resource(const pool_resource&) = delete;
+  pool_resource& operator=(const pool_resource&) = delete;
+
+  /**
+   * @brief 申请bytes字节、按照align对齐的内存
+   * @throw std::bad_alloc 申请失败
+   */
+  void* allocate(size_t bytes, size_t align) {
+    if (is_small(bytes, align)) {
+      return local().pop(*this, size_class(bytes));
+    }
+    if (bytes >= kMinArraySize) {
+      {
+        std::lock_guard<std::mutex> guard(arrays_mutex_);
+        auto it = arrays_.find(bytes);
+        if (it != arrays_.end() && !it->second.empty()) {
+          void* p = it->second.back();
+          it->second.pop_back();
+          cached_bytes_ -= bytes;
+          ++nr_array_hit_;
+          return p;
+        }
+        ++nr_array_miss_;
+      }
+      return aligned_new(bytes, kMaxAlign);
+    }
+    return align > alignof(std::max_align_t) ? aligned_new(bytes, align)
+                                              : ::operator new(bytes);
+  }
+
+  /// 释放allocate()申请的内存，bytes和align必须与申请时相同
+  void deallocate(void* p, size_t bytes, size_t align) noexcept {
+    if (is_small(bytes, align)) {
+      local().push(*this, size_class(bytes), p);
+      return;
+    }
+    if (bytes >= kMinArraySize) {
+      {
+        std::lock_guard<std::mutex> guard(arrays_mutex_);
+        if (cached_bytes_ + bytes <= max_cached_bytes_) {
+          // 放入缓存需要申请map节点或者扩大vector，申请失败时直接释放数组
+          try {
+            arrays_[bytes].push_back(p);
+            cached_bytes_ += bytes;
+            return;
+          } catch (...) {
+          }
+        }
+      }
+      aligned_delete(p);
+      return;
+    }
+    if (align > alignof(std::max_align_t)) {
+      aligned_delete(p);
+    } else {
+      ::operator delete(p);
+    }
+  }
+
+  /// 设置回收缓存中数组的最大总字节数，超出的部分立即释放
+  void max_cached_bytes(size_t n) {
+    std::lock_guard<std::mutex> guard(arrays_mutex_);
+    max_cached_bytes_ = n;
+    trim();
+  }
+
+  /// 获取回收缓存中数组的最大总字节数
+  size_t max_cached_bytes() const {
+    std::lock_guard<std::mutex> guard(arrays_mutex_);
+    return max_cached_bytes_;
+  }
+
+  /// 获取回收缓存中数组的总字节数
+  size_t cached_bytes() const {
+    std::lock_guard<std::mutex> guard(arrays_mutex_);
+    return cached_bytes_;
+  }
+
+  /// 释放回收缓存中的所有数组
+  void release() {
+    std::lock_guard<std::mutex> guard(arrays_mutex_);
+    for (auto& sized : arrays_) {
+      for (void* p : sized.second) {
+        aligned_delete(p);
+      }
+    }
+    arrays_.clear();
+    cached_bytes_ = 0;
+  }
+
+  /**
+   * @brief      获取统计指标
+   *
+   * @return     返回 json 格式的统计指标字符串
+   */
+  std::string stat() const {
+    std::lock_guard<std::mutex> guard(arrays_mutex_);
+    return "{\"cached_bytes\":" + std::to_string(cached_bytes_) +
+           ",\"max_cached_bytes\":" + std::to_string(max_cached_bytes_) +
+           ",\"nr_array_hit\":" + std::to_string(nr_array_hit_) +
+           ",\"nr_array_miss\":" + std::to_string(nr_array_miss_) +
+           ",\"nr_slab\":" + std::to_string(nr_slab_.load()) + "}";
+  }
+
+ private:
+  /// 小对象大小级别的个数
+  static constexpr size_t kNumClasses = kMaxSmallSize / 16;
+  /// 每块slab的字节数
+  static constexpr size_t kSlabSize = 64 * 1024;
+  /// 线程缓存与全局链表之间每次转移的对象个数
+  static constexpr size_t kBatch = 32;
+
+  /// 空闲链表的节点，复用空闲对象本身的内存
+  struct free_node {
+    free_node* next;
+  };
+
+  /// 一个大小级别的全局空闲链表
+  struct central_list {
+    std::mutex mutex;
+    free_node* head = nullptr;
+  };
+
+  /// 线程缓存，线程退出时把所有空闲对象归还给全局链表
+  struct thread_cache {
+    free_node* heads[kNumClasses] = {};
+    size_t counts[kNumClasses] = {};
+
+    ~thread_cache() {
+      pool_resource& pool = instance();
+      for (size_t c = 0; c < kNumClasses; ++c) {
+        pool.give_back(c, heads[c], counts[c]);
+      }
+    }
+
+    void* pop(pool_resource& pool, size_t c) {
+      if (heads[c] == nullptr) {
+        counts[c] = pool.take(c, heads[c]);
+      }
+      free_node* n = heads[c];
+      heads[c] = n->next;
+      --counts[c];
+      return n;
+    }
+
+    void push(pool_resource& pool, size_t c, void* p) {
+      free_node* n = static_cast<free_node*>(p);
+      n->next = heads[c];
+      heads[c] = n;
+      if (++counts[c] > 2 * kBatch) {
+        pool.give_back(c, heads[c], kBatch);
+        counts[c] -= kBatch;
+      }
+    }
+  };
+
+  pool_resource()
+      : max_cached_bytes_(size_t(256) << 20),
+        cached_bytes_(0),
+        nr_array_hit_(0),
+        nr_array_miss_(0),
+        nr_slab_(0) {}
+
+  static bool is_small(size_t bytes, size_t align) {
+    return bytes <= kMaxSmallSize && align <= 16;
+  }
+
+  static size_t size_class(size_t bytes) {
+    return bytes == 0 ? 0 : (bytes - 1) / 16;
+  }
+
+  static thread_cache& local() {
+    static thread_local thread_cache cache;
+    return cache;
+  }
+
+  /// 从全局链表领取最多kBatch个对象，全局链表为空时切分一块新的slab
+  size_t take(size_t c, free_node*& head) {
+    central_list& list = centrals_[c];
+    std::lock_guard<std::mutex> guard(list.mutex);
+    size_t n = 0;
+    while (list.head != nullptr && n < kBatch) {
+      free_node* node = list.head;
+      list.head = node->next;
+      node->next = head;
+      head = node;
+      ++n;
+    }
+    if (n != 0) {
+      return n;
+    }
+    const size_t size = (c + 1) * 16;
+    char* slab = static_cast<char*>(new_slab());
+    for (size_t off = 0; off + size <= kSlabSize; off += size) {
+      free_node* node = reinterpret_cast<free_node*>(slab + off);
+      node->next = head;
+      head = node;
+      ++n;
+    }
+    return n;
+  }
+
+  /// 把链表head开头的n个对象归还给全局链表，head指向剩余的部分
+  void give_back(size_t c, free_node*& head, size_t n) {
+    if (n == 0) {
+      return;
+    }
+    free_node* first = head;
+    free_node* last = head;
+    for (size_t i = 1; i < n; ++i) {
+      last = last->next;
+    }
+    head = last->next;
+    central_list& list = centrals_[c];
+    std::lock_guard<std::mutex> guard(list.mutex);
+    last->next = list.head;
+    list.head = first;
+  }
+
+  void* new_slab() {
+    void* slab = ::operator new(kSlabSize);
+    std::lock_guard<std::mutex> guard(slabs_mutex_);
+    slabs_.push_back(slab);
+    nr_slab_.fetch_add(1, std::memory_order_relaxed);
+    return slab;
+  }
+
+  /// 申请按照align对齐的内存，原始地址保存在对齐地址之前
+  static void* aligned_new(size_t bytes, size_t align) {
+    char* raw = static_cast<char*>(::operator new(bytes + align));
+    char* p = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(raw) + align) & ~(uintptr_t(align) - 1));
+    reinterpret_cast<char**>(p)[-1] = raw;
+    return p;
+  }
+
+  static void aligned_delete(void* p) noexcept {
+    ::operator delete(static_cast<char**>(p)[-1]);
+  }
+
+  /// 释放超出max_cached_bytes_的数组，调用者持有arrays_mutex_
+  void trim() {
+    for (auto it = arrays_.begin();
+         it != arrays_.end() && cached_bytes_ > max_cached_bytes_;) {
+      while (!it->second.empty() && cached_bytes_ > max_cached_bytes_) {
+        aligned_delete(it->second.back());
+        it->second.pop_back();
+        cached_bytes_ -= it->first;
+      }
+      it = it->second.empty() ? arrays_.erase(it) : std::next(it);
+    }
+  }
+
+  /// 各个大小级别的全局空闲链表
+  central_list centrals_[kNumClasses];
+  /// 所有申请的slab，保持可达以免被内存泄漏检测工具误报
+  std::vector<void*> slabs_;
+  std::mutex slabs_mutex_;
+
+  /// 按照字节数分组的回收数组
+  std::map<size_t, std::vector<void*>> arrays_;
+  mutable std::mutex arrays_mutex_;
+  size_t max_cached_bytes_;
+  size_t cached_bytes_;
+  uint64_t nr_array_hit_;
+  uint64_t nr_array_miss_;
+  std::atomic<uint64_t> nr_slab_;
+};
+
+/**
+ * @brief 使用pool_resource的无状态allocator，可以作为map等哈希表的Allocator模板参数
+ *
+ * @details
+ * 哈希表通过rebind_alloc为value、bucket数组以及自旋锁集合分别得到pool_allocator：
+ *          value等小对象使用线程缓存的slab，bucket数组在扩容或收缩释放之后进入回收缓存，
+ *          下一次申请相同大小的数组时直接复用
+ *
+ * @tparam T 分配的对象类型，对齐要求不能超过pool_resource::kMaxAlign
+ */
+template <typename T>
+class pool_allocator {
+  static_assert(alignof(T) <= pool_resource::kMaxAlign,
+                "pool_allocator does not support this alignment");
+
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind {
+    typedef pool_allocator<U> other;
+  };
+
+  pool_allocator() noexcept {}
+
+  template <typename U>
+  pool_allocator(const pool_allocator<U>&) noexcept {}
+
+  /// 申请n个T的内存
+  T* allocate(size_t n) {
+    if (n > size_t(-1) / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(
+        pool_resource::instance().allocate(n * sizeof(T), alignof(T)));
+  }
+
+  /// 释放allocate(n)申请的内存
+  void deallocate(T* p, size_t n) noexcept {
+    pool_resource::instance().deallocate(p, n * sizeof(T), alignof(T));
+  }
+};
+
+/// 所有pool_allocator共享同一个内存池，因此总是相等
+template <typename T, typename U>
+inline bool operator==(const pool_allocator<T>&, const pool_allocator<U>&) {
+  return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const pool_allocator<T>&, const pool_allocator<U>&) {
+  return false;
+}
+
+}  // namespace rbhash
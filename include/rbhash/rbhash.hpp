@@ -4,16 +4,26 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
 #include <atomic>
 #include <deque>
 #include <exception>
 #include <functional>
+#include <iterator>
 #include <limits>
 #include <list>
 #include <mutex>
 #include <new>
+#include <random>
+#include <string>
 #include <thread>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -35,6 +45,30 @@ using counter_type = int64_t;
  */
 #define HASHMAP_MAX_EXTRA_WORKER 8U
 
+/**
+ * @brief 每个CPU核心分配的自旋锁数目；哈希表默认的自旋锁数目为
+ *        hardware_concurrency * HASHMAP_LOCKS_PER_CORE（向上取整为2的幂）
+ */
+#define HASHMAP_LOCKS_PER_CORE 16U
+
+/**
+ * @brief bucket数组不小于该字节数时直接通过mmap申请，扩容时使用mremap原地增长
+ *
+ * @note 仅在Linux上、键和值都可以按字节拷贝且使用std::allocator时生效
+ */
+#ifndef HASHMAP_MMAP_MIN_BYTES
+#define HASHMAP_MMAP_MIN_BYTES (2UL << 20)
+#endif
+
+/**
+ * @brief 软件预取，rw为0表示预取后读、为1表示预取后写；不支持的编译器上为空操作
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define HASHMAP_PREFETCH(addr, rw) __builtin_prefetch((addr), (rw), 3)
+#else
+#define HASHMAP_PREFETCH(addr, rw) ((void)(addr))
+#endif
+
 /**
  * @brief 使用C++11 atomic库中atomic_flag实现的自旋锁，哈希表内部使用
  *
@@ -132,6 +166,28 @@ class alignas(64) spinlock_t {
   bool is_migrated_;
 };
 
+/**
+ * @brief 作为map的Value类型时表示不保存value，bucket中只保存key，供set使用
+ *
+ * @note Value为key_only时不能通过kvpair()以及locked_table迭代器的解引用访问元素，
+ *       需要使用key()
+ */
+struct key_only {};
+
+/**
+ * @brief Value为key_only时bucket中实际使用的存储类型，利用空基类优化只保存key
+ */
+template <typename Key>
+struct key_only_storage : key_only {
+  /// 与std::pair的逐段构造兼容，value部分的参数被忽略
+  template <typename K, typename... Args>
+  key_only_storage(std::piecewise_construct_t, std::tuple<K> k,
+                   std::tuple<Args...>)
+      : first(std::forward<K>(std::get<0>(k))) {}
+
+  Key first;
+};
+
 /**
  * @brief 哈希表中使用Table作为底层存储来保存所有键值对，本质上是一个数组
  *
@@ -175,11 +231,13 @@ class table {
 
     /// 获取键值对的const左值引用
     const value_type& kvpair() const {
+      static_assert(!is_key_only::value, "key_only bucket has no kvpair");
       return *static_cast<const value_type*>(
           static_cast<const void*>(&storage_));
     }
     /// 获取键值对的左值引用，一般用于赋值
     value_type& kvpair() {
+      static_assert(!is_key_only::value, "key_only bucket has no kvpair");
       return *static_cast<value_type*>(static_cast<void*>(&storage_));
     }
 
@@ -189,12 +247,12 @@ class table {
     key_type&& movable_key() { return std::move(storage_kvpair().first); }
 
     /// 获取Value的const左值引用
-    const mapped_type& mapped() const { return storage_kvpair().second; }
+    const mapped_type& mapped() const { return second(storage_kvpair()); }
     /// 获取Value的左值引用，一般用于赋值
-    mapped_type& mapped() { return storage_kvpair().second; }
+    mapped_type& mapped() { return second(storage_kvpair()); }
     /// 获取Value的右值引用，一般用于赋值
     mapped_type&& movable_mapped() {
-      return std::move(storage_kvpair().second);
+      return std::move(second(storage_kvpair()));
     }
 
     /// 获取占用标志位的左值引用，一般用于赋值
@@ -207,11 +265,29 @@ class table {
     /// 获取删除标志位的当前值
     bool deleted() const { return deleted_; }
 
+    /// 获取key哈希值的左值引用，一般用于赋值
+    size_type& hash() { return hash_value_; }
+    /// 获取key的哈希值
+    size_type hash() const { return hash_value_; }
+
    private:
     friend class table;
 
+    /// Value为key_only时只保存key
+    using is_key_only = std::is_same<Value, key_only>;
     /// 定义底层使用的具体存储类型，注意和value_type不同
-    using storage_value_type = std::pair<Key, Value>;
+    using storage_value_type =
+        typename std::conditional<is_key_only::value, key_only_storage<Key>,
+                                  std::pair<Key, Value>>::type;
+    /// 获取存储类型中value部分的引用
+    static Value& second(std::pair<Key, Value>& kv) { return kv.second; }
+    static const Value& second(const std::pair<Key, Value>& kv) {
+      return kv.second;
+    }
+    static key_only& second(key_only_storage<Key>& kv) { return kv; }
+    static const key_only& second(const key_only_storage<Key>& kv) {
+      return kv;
+    }
     /// 获取底层实际使用存储类型的const左值引用
     const storage_value_type& storage_kvpair() const {
       return *static_cast<const storage_value_type*>(
@@ -246,10 +322,14 @@ class table {
       : hashpower_(hp),
         allocator_(allocator),
         bucket_allocator_(allocator_),
-        buckets_(bucket_allocator_.allocate(size())) {
+        buckets_(allocate_buckets(hp)) {
     assert(buckets_ != nullptr);
     static_assert(std::is_nothrow_constructible<bucket>::value,
                   "table requires bucket to be nothrow constructible");
+    if (mapped(hp)) {
+      // 匿名映射的内存全部为0，与bucket()构造出的状态相同
+      return;
+    }
     for (int i = 0; i < size(); ++i) {
       traits_::construct(allocator_, &buckets_[i]);
     }
@@ -341,6 +421,18 @@ class table {
     b.deleted() = false;
   }
 
+  /// 键和值都可以按字节拷贝时，将src整体（包括标志位和哈希值）拷贝到ind指向的bucket
+  void copyKV(size_type ind, const bucket& src) {
+    static_assert(std::is_trivially_copyable<key_type>::value &&
+                      std::is_trivially_copyable<mapped_type>::value,
+                  "copyKV requires trivially copyable key and value");
+    bucket& b = buckets_[ind];
+    assert(!b.occupied() || b.deleted());
+    assert(src.occupied() && !src.deleted());
+    memcpy(static_cast<void*>(&b), static_cast<const void*>(&src),
+           sizeof(bucket));
+  }
+
   /// 销毁（析构但不释放内存）table中ind指向的bucket中的数据，但并不清除occupied标志位，而设置deleted标志位
   void eraseKV(size_type ind) {
     bucket& b = buckets_[ind];
@@ -358,13 +450,9 @@ class table {
                       std::is_nothrow_destructible<mapped_type>::value,
                   "table requires key and value to be nothrow destructible");
     if (buckets_ == nullptr) return;
-    for (size_type i = 0; i < size(); ++i) {
-      bucket& b = buckets_[i];
-      if (b.occupied() && !b.deleted()) {
-        eraseKV(i);
-      }
-      b.occupied() = false;
-    }
+    clear(std::integral_constant<
+          bool, std::is_trivially_destructible<key_type>::value &&
+                    std::is_trivially_destructible<mapped_type>::value>());
   }
 
   /// 辅助函数，销毁buckets保存的数据并释放buckets内存空间
@@ -378,14 +466,100 @@ class table {
     for (size_type i = 0; i < size(); ++i) {
       traits_::destroy(allocator_, &buckets_[i]);
     }
-    bucket_allocator_.deallocate(buckets_, size());
+    deallocate_buckets(buckets_, hashpower());
     buckets_ = nullptr;
   }
 
+  /**
+   * @brief 通过mremap将bucket数组原地扩大为2的new_hp次幂，新增的bucket都是空的
+   *
+   * @return true 扩大成功，原有bucket的下标不变；hashpower保持不变，由调用者在
+   *         重新放置元素之后设置
+   * @return false 当前数组不是通过mmap申请的或者mremap失败，数组保持不变
+   */
+  bool remap(size_type new_hp) {
+#ifdef __linux__
+    const size_type hp = hashpower();
+    if (buckets_ == nullptr || new_hp <= hp || !mapped(hp)) {
+      return false;
+    }
+    void* p = mremap(buckets_, sizeof(bucket) * size(),
+                     sizeof(bucket) * (size_type(1) << new_hp), MREMAP_MAYMOVE);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    buckets_ = static_cast<bucket*>(p);
+    return true;
+#else
+    (void)new_hp;
+    return false;
+#endif
+  }
+
+  /// bucket数组是否通过mmap申请（参见HASHMAP_MMAP_MIN_BYTES）
+  static bool mapped(size_type hp) {
+#ifdef __linux__
+    return is_mappable::value &&
+           sizeof(bucket) * (size_type(1) << hp) >= HASHMAP_MMAP_MIN_BYTES;
+#else
+    (void)hp;
+    return false;
+#endif
+  }
+
   /// 返回占用的内存大小，字节数
-  size_t footprint() const { return sizeof(bucket) * size(); }
+  size_t footprint() const {
+    return buckets_ == nullptr ? 0 : sizeof(bucket) * size();
+  }
 
  private:
+  /// 键和值都不需要析构时，直接将所有bucket清零（与bucket()构造出的状态相同）
+  void clear(std::true_type) noexcept {
+    memset(static_cast<void*>(buckets_), 0, sizeof(bucket) * size());
+  }
+
+  /// 逐个析构仍然有效的键值对，并清除占用标志位
+  void clear(std::false_type) noexcept {
+    for (size_type i = 0; i < size(); ++i) {
+      bucket& b = buckets_[i];
+      if (b.occupied() && !b.deleted()) {
+        eraseKV(i);
+      }
+      b.occupied() = false;
+    }
+  }
+
+  /// 键和值都可以按字节拷贝并且使用默认分配器时，大数组可以直接通过mmap申请
+  using is_mappable = std::integral_constant<
+      bool, std::is_trivially_copyable<key_type>::value &&
+                std::is_trivially_copyable<mapped_type>::value &&
+                std::is_same<typename traits_::template rebind_alloc<bucket>,
+                             std::allocator<bucket>>::value>;
+
+  bucket* allocate_buckets(size_type hp) {
+#ifdef __linux__
+    if (mapped(hp)) {
+      void* p = mmap(nullptr, sizeof(bucket) * (size_type(1) << hp),
+                     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+      return static_cast<bucket*>(p);
+    }
+#endif
+    return bucket_allocator_.allocate(size_type(1) << hp);
+  }
+
+  void deallocate_buckets(bucket* p, size_type hp) noexcept {
+#ifdef __linux__
+    if (mapped(hp)) {
+      munmap(p, sizeof(bucket) * (size_type(1) << hp));
+      return;
+    }
+#endif
+    bucket_allocator_.deallocate(p, size_type(1) << hp);
+  }
+
   template <typename A>
   void swap_allocator(A& dst, A& src, std::true_type) {
     std::swap(dst, src);
@@ -403,6 +577,55 @@ class table {
   bucket* buckets_ = nullptr;
 };
 
+/**
+ * @brief 判断哈希函数或相等函数是否支持异构查找（定义了is_transparent类型）
+ */
+template <typename T, typename = void>
+struct is_transparent : std::false_type {};
+
+template <typename T>
+struct is_transparent<
+    T, typename std::conditional<true, void, typename T::is_transparent>::type>
+    : std::true_type {};
+
+/**
+ * @brief 在以哈希值的低位作为bucket索引之前，对哈希函数的结果做的混合（finalizer）
+ *
+ * @details
+ * libstdc++中整数的std::hash是恒等函数，连续或等间隔的整数key直接映射到相邻或
+ *          等间隔的bucket上，线性探测下容易形成很长的连续区段
+ *          - identity：不做处理，直接使用哈希函数的结果（默认，兼容已有行为）
+ *          - fibonacci：乘以2^64/phi后将高位异或到低位（multiply-shift），开销最小
+ *          - murmur：murmur3的fmix64，雪崩效果最好，适合低质量的哈希函数
+ */
+enum class hash_mixer { identity, fibonacci, murmur };
+
+/// 按照给定的策略混合64位哈希值
+inline uint64_t mix_hash(hash_mixer mixer, uint64_t h) {
+  switch (mixer) {
+    case hash_mixer::fibonacci:
+      h *= 0x9E3779B97F4A7C15ULL;
+      return h ^ (h >> 32);
+    case hash_mixer::murmur:
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      return h ^ (h >> 33);
+    default:
+      return h;
+  }
+}
+
+/**
+ * @brief 生成一个非0的随机种子，用于map::seed()
+ */
+inline uint64_t random_seed() {
+  std::random_device rd;
+  const uint64_t seed = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+  return seed | 1;
+}
+
 /**
  * @brief
  * 并发线程安全的哈希表实现，使用线性探测法解决哈希冲突；插入冲突时，将自动触发哈希表的扩容（linear_rehash()）
@@ -450,9 +673,31 @@ class map {
   /// 定义key_equal为模板参数KeyEqual函数的别名
   using key_equal = KeyEqual;
 
+  /**
+   * @brief 对key进行哈希之后的哈希值，可以通过hash_of()预先计算，传给接受哈希值的
+   *        find/insert/upsert/erase/update_fn重载，避免对同一个key重复计算哈希
+   * @note 哈希值已经经过mixer()的混合，只能用于哈希函数和混合策略都相同的map
+   */
+  struct hash_value {
+    size_type hash;
+  };
+
+  /// 第一个参数为hash_value时，不匹配以key作为第一个参数的重载
+  template <typename K>
+  using disable_if_hash_value = typename std::enable_if<
+      !std::is_same<typename std::decay<K>::type, hash_value>::value>::type;
+
   /// 前向声明locked_table类型，表示锁定状态的哈希表（用于迭代器实现）
   class locked_table;
 
+  /// 前向声明basic_locked_ptr类型，持有单个元素所在bucket自旋锁的访问句柄
+  template <bool IsConst>
+  class basic_locked_ptr;
+  /// 可修改value的访问句柄
+  using locked_ptr = basic_locked_ptr<false>;
+  /// 只读的访问句柄
+  using const_locked_ptr = basic_locked_ptr<true>;
+
   /**
    * @brief 构造给定容量的rb_hashmap，初始状态为空
    *
@@ -466,8 +711,12 @@ class map {
         eq_fn_(eq_f),
         buckets_(hp, alloc),
         old_buckets_(),
-        max_num_worker_threads_(HASHMAP_MAX_EXTRA_WORKER) {
-    all_locks_.emplace_back(std::min(bucket_count(), size_type(kMaxNumLocks)));
+        max_num_worker_threads_(HASHMAP_MAX_EXTRA_WORKER),
+        max_num_locks_(default_num_locks()),
+        mixer_(hash_mixer::identity),
+        seed_(0),
+        layout_version_(0) {
+    all_locks_.emplace_back(lock_count(bucket_count()));
   }
 
   /**
@@ -487,9 +736,7 @@ class map {
       const Hash& hf = Hash(), const KeyEqual& eq_f = KeyEqual(),
       const Allocator& alloc = Allocator())
       : map(hp, hf, eq_f, alloc) {
-    for (; first != last; ++first) {
-      insert(first->first, first->second);
-    }
+    insert_bulk(first, last);
   }
 
   /**
@@ -503,6 +750,10 @@ class map {
         buckets_(std::move(other.buckets_)),
         old_buckets_(std::move(other.old_buckets_)),
         max_num_worker_threads_(other.max_num_worker_threads()),
+        max_num_locks_(other.max_num_locks()),
+        mixer_(other.mixer_),
+        seed_(other.seed()),
+        layout_version_(other.layout_version()),
         all_locks_(std::move(other.all_locks_)) {}
 
   /**
@@ -540,10 +791,31 @@ class map {
 
   /// 定义了允许的最大自旋锁集合大小
   static constexpr size_type kMaxNumLocks = 1UL << 16;
+  /// find_batch()每组同时预取的key的个数
+  static constexpr size_type kFindBatchGroup = 16;
+  /// upsert_batch()每组一次性加锁的元素个数
+  static constexpr size_type kUpsertBatchGroup = 64;
+  /// insert_bulk()使用多线程并行放置元素的最小区间长度
+  static constexpr size_type kMinParallelBulkSize = 1UL << 14;
+  /// 探测过长触发扩容时，负载率低于该值视为哈希冲突（参见locked_probe_expand()）
+  static constexpr double kFloodLoadFactor = 0.125;
 
   /// 获取当前时刻哈希表拥有的自旋锁集合
   locks_t& get_current_locks() const { return all_locks_.back(); }
 
+  /**
+   * @brief 根据CPU核心数计算默认的自旋锁数目，结果为2的幂且不超过kMaxNumLocks
+   *
+   * @note 自旋锁数目只与核心数相关，与哈希表大小无关，因此锁占用的内存以及
+   *       lock_all()的耗时不会随哈希表的扩容而增长
+   */
+  static size_type default_num_locks() {
+    const size_type cores =
+        std::max(1U, std::thread::hardware_concurrency());
+    return next_pow2(
+        std::min(size_type(kMaxNumLocks), cores * HASHMAP_LOCKS_PER_CORE));
+  }
+
   /// 获取哈希函数
   hasher hash_function() const { return hash_fn_; }
 
@@ -602,6 +874,85 @@ class map {
     return max_num_worker_threads_.load(std::memory_order_acquire);
   }
 
+  /**
+   * @brief 设置哈希表允许使用的最大自旋锁数目，向上取整为2的幂，且不超过kMaxNumLocks
+   *
+   * @param n 最大自旋锁数目；实际使用的锁数目为min(n, bucket_count())
+   * @note 非线程安全，必须在哈希表被多个线程共享之前调用
+   */
+  void max_num_locks(size_type n) {
+    auto all_locks_manager = lock_all();
+    if (!all_locks_manager) return;
+    max_num_locks_ = next_pow2(std::min(size_type(kMaxNumLocks), n));
+    const size_type count = lock_count(bucket_count());
+    locks_t& current_locks = get_current_locks();
+    if (count == current_locks.size()) {
+      return;
+    }
+    // 锁数目发生变化，按照新的lock_ind()重新统计各个自旋锁负责的元素个数
+    const bool has_elements = size() != 0;
+    std::vector<counter_type> counters(count, 0);
+    for (size_type i = 0; has_elements && i < bucket_count(); ++i) {
+      const auto& b = buckets_[i];
+      if (b.occupied() && !b.deleted()) {
+        ++counters[i & (count - 1)];
+      }
+    }
+    // 其他线程可能仍在旧的自旋锁上等待，旧锁保留在all_locks_中，不能释放
+    locks_t new_locks(count);
+    for (size_type i = 0; i < count; ++i) {
+      new_locks[i].lock();
+      new_locks[i].elem_counter() = counters[i];
+    }
+    all_locks_.emplace_back(std::move(new_locks));
+    bump_layout_version();
+  }
+
+  /// 获取哈希表允许使用的最大自旋锁数目
+  size_type max_num_locks() const { return max_num_locks_; }
+
+  /**
+   * @brief 设置对哈希函数结果的混合策略，哈希表非空时按照新的策略重新放置所有元素
+   *
+   * @param m 混合策略，参见hash_mixer
+   * @note 非线程安全，必须在哈希表被多个线程共享之前调用；
+   *       修改之前通过hash_of()得到的哈希值不再有效
+   */
+  void mixer(hash_mixer m) {
+    auto all_locks_manager = lock_all();
+    if (!all_locks_manager || m == mixer_) return;
+    mixer_ = m;
+    if (size() != 0) {
+      locked_expand(hashpower(), seed(), true);
+    }
+  }
+
+  /// 获取哈希表当前使用的混合策略
+  hash_mixer mixer() const { return mixer_; }
+
+  /**
+   * @brief 设置计算bucket索引时使用的种子，哈希表非空时按照新的种子重新放置所有元素
+   *
+   * @param seed 种子，0表示不使用种子（默认）；对外部输入的key可以使用random_seed()
+   * @note 非线程安全，必须在哈希表被多个线程共享之前调用
+   * @note 种子只参与bucket索引的计算，hash_of()得到的哈希值不受影响
+   * @note 种子在Hash计算之后才混入哈希值，只能打散哈希值不同、bucket索引相同的key；
+   *       Hash本身的完全碰撞（哈希值相同）不受种子影响，需要使用带种子的Hash抵御
+   */
+  void seed(uint64_t seed) {
+    auto all_locks_manager = lock_all();
+    if (!all_locks_manager || seed == this->seed()) return;
+    if (size() != 0) {
+      locked_expand(hashpower(), seed);
+    } else {
+      seed_.store(seed, std::memory_order_release);
+      bump_layout_version();
+    }
+  }
+
+  /// 获取哈希表当前使用的种子
+  uint64_t seed() const { return seed_.load(std::memory_order_acquire); }
+
   /**
    * @brief Key-Value插入操作的API接口
    *
@@ -615,21 +966,82 @@ class map {
    * @note 如果待插入的元素已经存在，则插入失败，返回false
    * @see insert_or_assign
    */
-  template <typename K, typename... Args>
+  template <typename K, typename... Args,
+            typename = disable_if_hash_value<K>>
   bool insert(K&& key, Args&&... val) {
     return upsert(std::forward<K>(key), [](mapped_type&) {},
                   std::forward<Args>(val)...);
   }
 
+  /// 使用预先计算的哈希值进行插入，hv必须为hash_of(key)的结果
+  template <typename K, typename... Args>
+  bool insert(const hash_value& hv, K&& key, Args&&... val) {
+    return upsert(hv, std::forward<K>(key), [](mapped_type&) {},
+                  std::forward<Args>(val)...);
+  }
+
+  /**
+   * @brief 计算key的哈希值（已按照mixer()混合），结果可以在多个哈希函数和混合策略
+   *        都相同的map中重复使用
+   *
+   * @tparam K 键（Key）类型
+   * @param key 具体键（key）
+   * @return hash_value key的哈希值
+   */
+  template <typename K>
+  hash_value hash_of(const K& key) const {
+    return hashed_key(lookup_key(key));
+  }
+
+  /**
+   * @brief 原地构造插入的API接口，key已经存在时不构造任何对象（包括key和value）
+   *
+   * @tparam K 待插入键（Key）的类型
+   * @tparam Args 可变参模板参数，用于构造Value
+   * @param key 待插入的具体键（key），只有插入成功时才会被移动
+   * @param args 用于原地构造value的参数，只有插入成功时才会被使用
+   * @return true 插入成功
+   * @return false key已经存在
+   * @see insert()
+   */
+  template <typename K, typename... Args>
+  bool try_emplace(K&& key, Args&&... args) {
+    return insert(std::forward<K>(key), std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief 查找key，不存在时使用factory()的返回值构造value并插入
+   *
+   * @tparam K 待查找或插入的键（Key）类型
+   * @tparam F 形如mapped_type()的函数类型，返回值用于构造value
+   * @param key 待查找或插入的具体键（key）
+   * @param factory 只有key不存在时才会被调用
+   * @return locked_ptr 指向已有的或者新插入的键值对的访问句柄（总是非空）
+   * @see find_ptr()
+   */
+  template <typename K, typename F>
+  locked_ptr get_or_insert_with(K&& key, F factory) {
+    const hash_value hv = hashed_key(key);
+    table_position pos = linear_insert_loop(key, hv);
+    if (pos.status == ok) {
+      add_to_bucket(pos.index, hv, std::forward<K>(key), factory());
+    }
+    return locked_ptr(std::move(pos.lock), &buckets_[pos.index].kvpair());
+  }
+
   /**
    * @brief
    * 哈希表插入或者修改API接口，如果key不存在，则插入；如果存在，则对value部分进行赋值
    *
+   * @note val为右值时，插入和赋值都使用移动语义
    * @see insert()
    */
   template <typename K, typename V>
   bool insert_or_assign(K&& key, V&& val) {
-    return upsert(std::forward<K>(key), [&val](mapped_type& m) { m = val; },
+    // the assignment and the construction never both happen, so val is
+    // forwarded at most once
+    return upsert(std::forward<K>(key),
+                  [&val](mapped_type& m) { m = std::forward<V>(val); },
                   std::forward<V>(val));
   }
 
@@ -643,11 +1055,18 @@ class map {
    * @return false key不在哈希表中
    * @see update_fn()
    */
-  template <typename K>
+  template <typename K, typename = disable_if_hash_value<K>>
   bool find(const K& key, mapped_type& val) const {
     return find_fn(key, [&val](const mapped_type& v) mutable { val = v; });
   }
 
+  /// 使用预先计算的哈希值进行查找，hv必须为hash_of(key)的结果
+  template <typename K>
+  bool find(const hash_value& hv, const K& key, mapped_type& val) const {
+    return find_fn(hv, key,
+                   [&val](const mapped_type& v) mutable { val = v; });
+  }
+
   /**
    * @brief Key-Value查找的API接口
    *
@@ -658,8 +1077,18 @@ class map {
    */
   template <typename K>
   mapped_type find(const K& key) {
-    const hash_value hv = hashed_key(key);
-    table_position pos = linear_find_loop(key, hv);
+    const auto& k = lookup_key(key);
+    return find(hashed_key(k), k);
+  }
+
+  /**
+   * @brief 使用预先计算的哈希值进行查找，hv必须为hash_of(key)的结果
+   * @note 如果key不存在表中，则会抛std::out_of_range异常
+   */
+  template <typename K>
+  mapped_type find(const hash_value& hv, const K& key) {
+    const auto& k = lookup_key(key);
+    table_position pos = linear_find_loop(k, hv);
     if (pos.status == ok) {
       return buckets_[pos.index].mapped();
     } else {
@@ -667,6 +1096,85 @@ class map {
     }
   }
 
+  /**
+   * @brief 查找key并返回持有其所在bucket自旋锁的访问句柄，不拷贝value，也不抛异常
+   *
+   * @tparam K 待查找的键（Key）类型
+   * @param key 待查找的具体键（key）
+   * @return locked_ptr key存在时为指向键值对的非空句柄；key不存在时为空句柄
+   *
+   * @note 句柄析构或调用reset()之前一直持有自旋锁，同一自旋锁上的其他操作以及扩容都会等待；
+   *       持有句柄期间不能在同一线程中再调用本哈希表的其他接口，否则可能死锁
+   */
+  template <typename K>
+  locked_ptr find_ptr(const K& key) {
+    const auto& k = lookup_key(key);
+    table_position pos = linear_find_loop(k, hashed_key(k));
+    if (pos.status != ok) {
+      return locked_ptr();
+    }
+    return locked_ptr(std::move(pos.lock), &buckets_[pos.index].kvpair());
+  }
+
+  /// 查找key并返回只读的访问句柄，key不存在时为空句柄
+  template <typename K>
+  const_locked_ptr find_ptr(const K& key) const {
+    const auto& k = lookup_key(key);
+    table_position pos = linear_find_loop(k, hashed_key(k));
+    if (pos.status != ok) {
+      return const_locked_ptr();
+    }
+    return const_locked_ptr(std::move(pos.lock),
+                            &buckets_[pos.index].kvpair());
+  }
+
+  /**
+   * @brief 批量查找的API接口
+   *
+   * @tparam K 待查找的键（Key）类型
+   * @param keys 待查找的key数组
+   * @param n key的个数
+   * @param out 查找结果数组，key存在时out[i]为其关联的value，否则out[i]保持不变；
+   *            为nullptr时只填充found_mask
+   * @param found_mask 位图，至少(n + 63) / 64个元素；key存在时第i位置1，否则置0
+   * @return size_type 存在于哈希表中的key的个数
+   *
+   * @note 每kFindBatchGroup个key为一组：先计算整组key的哈希值，并预取每个key的home bucket
+   *       和对应的自旋锁，再逐个加锁查找；预取的访存延迟在组内相互重叠。每个key的查找
+   *       各自加锁，与find()的语义相同，整个批次不是原子的
+   */
+  template <typename K>
+  size_type find_batch(const K* keys, size_type n, mapped_type* out,
+                       uint64_t* found_mask) const {
+    std::fill(found_mask, found_mask + (n + 63) / 64, 0);
+    size_type found = 0;
+    hash_value hvs[kFindBatchGroup];
+    for (size_type base = 0; base < n; base += kFindBatchGroup) {
+      const size_type cnt = std::min(size_type(kFindBatchGroup), n - base);
+      const size_type hp = hashpower();
+      const locks_t& locks = get_current_locks();
+      for (size_type j = 0; j < cnt; ++j) {
+        hvs[j] = hashed_key(keys[base + j]);
+        const size_type ind = home_index(hp, hvs[j].hash);
+        HASHMAP_PREFETCH(&buckets_[ind], 0);
+        HASHMAP_PREFETCH(&locks[lock_ind(ind)], 1);
+      }
+      for (size_type j = 0; j < cnt; ++j) {
+        table_position pos =
+            linear_find_loop(lookup_key(keys[base + j]), hvs[j]);
+        if (pos.status == ok) {
+          const size_type i = base + j;
+          if (out != nullptr) {
+            out[i] = buckets_[pos.index].mapped();
+          }
+          found_mask[i / 64] |= uint64_t(1) << (i % 64);
+          ++found;
+        }
+      }
+    }
+    return found;
+  }
+
   /**
    * @brief Key-Value更新的API接口
    *
@@ -697,9 +1205,17 @@ class map {
    * @return false 更新或插入失败
    * @see uprase_fn
    */
-  template <typename K, typename F, typename... Args>
+  template <typename K, typename F, typename... Args,
+            typename = disable_if_hash_value<K>>
   bool upsert(K&& key, F fn, Args&&... val) {
-    return uprase_fn(std::forward<K>(key),
+    const hash_value hv = hashed_key(key);
+    return upsert(hv, std::forward<K>(key), fn, std::forward<Args>(val)...);
+  }
+
+  /// 使用预先计算的哈希值进行更新或插入，hv必须为hash_of(key)的结果
+  template <typename K, typename F, typename... Args>
+  bool upsert(const hash_value& hv, K&& key, F fn, Args&&... val) {
+    return uprase_fn(hv, std::forward<K>(key),
                      [&fn](mapped_type& v) {
                        fn(v);
                        return false;
@@ -721,6 +1237,12 @@ class map {
     return erase_fn(key, [](mapped_type&) { return true; });
   }
 
+  /// 使用预先计算的哈希值进行删除，hv必须为hash_of(key)的结果
+  template <typename K>
+  bool erase(const hash_value& hv, const K& key) {
+    return erase_fn(hv, key, [](mapped_type&) { return true; });
+  }
+
   /// 哈希表容量收缩API接口
   void shrink() {
     while (load_factor() <= 1 / 4) {
@@ -739,6 +1261,67 @@ class map {
   /// 哈希表reserve接口，预留能容纳n个key-value对的内存空间
   bool reserve(size_type n) { return linear_reserve(n); }
 
+  /**
+   * @brief 批量插入API接口，整个过程只加一次全表锁
+   *
+   * @tparam InputIt 迭代器类型，可以通过it->first, it->second访问到key和value
+   * @param first 起始迭代器
+   * @param last 终止迭代器（不包含）
+   * @return size_type 成功插入的元素个数；已经存在的key（包括区间内重复的key）不会被覆盖
+   *
+   * @note 对于前向迭代器，根据区间长度一次性预留空间（同reserve()）；对于随机访问迭代器，
+   *       且区间足够大时，使用max_num_worker_threads()个额外线程并行计算哈希值，并按照
+   *       home bucket把元素划分到连续的bucket区间，各线程在自己的区间内直接放置元素；
+   *       探测越过区间边界的少量元素最后由当前线程补充插入
+   */
+  template <typename InputIt>
+  size_type insert_bulk(InputIt first, InputIt last) {
+    auto all_locks_manager = lock_all();
+    if (!all_locks_manager) return 0;
+    return locked_insert_bulk(
+        first, last,
+        typename std::iterator_traits<InputIt>::iterator_category());
+  }
+
+  /**
+   * @brief 可恢复的分批遍历API接口（类似Redis的SCAN），两次调用之间不持有任何锁
+   *
+   * @tparam F 形如void(const key_type&, mapped_type&)的函数类型
+   * @param cursor 遍历游标，第一次调用传入0，之后传入上一次调用的返回值
+   * @param count 本次调用期望访问的元素个数（近似值）
+   * @param fn 对每个键值对进行的操作，执行时持有该键值对所在bucket的自旋锁
+   * @return size_type 下一次调用使用的游标；返回0表示遍历结束
+   *
+   * @note 游标按照二进制逆序递增的顺序遍历key的home bucket（即home_index()的结果），每个
+   *       home bucket访问其探测窗口内所有以它为home的元素。由于哈希表按照2的幂扩容，home_index
+   *       取（打散后的）哈希值的低位，因此即使两次调用之间发生了扩容或收缩，整个遍历期间一直
+   *       存在的元素也至少会被返回一次；发生收缩或者调用中途发生扩容时，部分元素可能被返回
+   *       多次；遍历期间更换了种子（参见seed()）时不再有该保证
+   * @note fn中不能再调用本哈希表的接口，否则可能死锁
+   */
+  template <typename F>
+  size_type scan(size_type cursor, size_type count, F fn) {
+    size_type emitted = 0;
+    do {
+      size_type hp;
+      while (true) {
+        const size_type version = layout_version();
+        hp = hashpower();
+        try {
+          emitted +=
+              scan_home_bucket(version, hp, index_hash(hp, cursor), fn);
+          break;
+        } catch (hashpower_changed&) {
+          // The hashpower changed during the visit. Visit the cursor again.
+        }
+      }
+      // reverse binary increment of the low hp bits
+      cursor |= ~hashmask(hp);
+      cursor = reverse_bits(reverse_bits(cursor) + 1);
+    } while (cursor != 0 && emitted < count);
+    return cursor;
+  }
+
   /**
    * @brief 清空哈希表的API接口函数，不释放内存
    * @see linear_clear()
@@ -766,14 +1349,66 @@ class map {
   /// 从this指针构造locked_table，哈希表将处于被锁住的状态
   locked_table lock_table() { return locked_table(*this); }
 
+  /**
+   * @brief 弱一致性的并发遍历API接口，按照自旋锁逐个遍历，任意时刻只持有一个自旋锁
+   *
+   * @tparam F 形如void(const key_type&, mapped_type&)的函数类型
+   * @param fn 对每个键值对进行的操作，执行时持有该键值对所在bucket的自旋锁
+   *
+   * @note 弱一致性：遍历期间一直存在的元素至少被访问一次；遍历期间插入或删除的元素可能被访问，
+   *       也可能不被访问。如果遍历期间发生了扩容或收缩，则在新表上从头重新遍历，此时部分元素
+   *       可能被访问多次
+   * @note fn中不能再调用本哈希表的接口，否则可能死锁
+   * @see lock_table()
+   */
+  template <typename F>
+  void for_each(F fn) {
+    size_type version = layout_version();
+    size_type hp = hashpower();
+    size_type stripe = 0;
+    while (true) {
+      locks_t& locks = get_current_locks();
+      if (stripe >= locks.size()) {
+        return;
+      }
+      spinlock_t& lock = locks[stripe];
+      lock.lock();
+      LockManager guard(&lock);
+      if (layout_version() != version) {
+        // The layout changed during the scan. Start over on the new table.
+        version = layout_version();
+        hp = hashpower();
+        stripe = 0;
+        continue;
+      }
+      for (size_type i = stripe; i < hashsize(hp); i += locks.size()) {
+        auto& b = buckets_[i];
+        if (b.occupied() && !b.deleted()) {
+          fn(b.key(), b.mapped());
+        }
+      }
+      ++stripe;
+    }
+  }
+
   /**
    * @brief      获取统计指标
    *
    * @return     返回 json 格式的统计指标字符串
    */
   std::string stat() {
-    // TODO
-    return "";
+    return "{\"size\":" + std::to_string(size()) +
+           ",\"capacity\":" + std::to_string(capacity()) +
+           ",\"hashpower\":" + std::to_string(hashpower()) +
+           ",\"load_factor\":" + std::to_string(load_factor()) +
+           ",\"footprint\":" + std::to_string(footprint()) +
+           ",\"num_locks\":" + std::to_string(
+               all_locks_.empty() ? 0 : get_current_locks().size()) +
+           ",\"nr_expand_or_shrink\":" + std::to_string(nr_expand_or_shrink) +
+           ",\"nr_clear\":" + std::to_string(nr_clear) +
+           ",\"nr_reseed\":" + std::to_string(nr_reseed) +
+           ",\"nr_expand_in_place\":" + std::to_string(nr_expand_in_place) +
+           "}";
   }
 
   /**
@@ -790,8 +1425,14 @@ class map {
    */
   template <typename K, typename F>
   bool find_fn(const K& key, F fn) const {
-    const hash_value hv = hashed_key(key);
-    table_position pos = linear_find_loop(key, hv);
+    const auto& k = lookup_key(key);
+    return find_fn(hashed_key(k), k, fn);
+  }
+
+  /// 使用预先计算的哈希值的find_fn()，hv必须为hash_of(key)的结果
+  template <typename K, typename F>
+  bool find_fn(const hash_value& hv, const K& key, F fn) const {
+    table_position pos = linear_find_loop(lookup_key(key), hv);
     if (pos.status == ok) {
       fn(buckets_[pos.index].mapped());
       return true;
@@ -810,14 +1451,184 @@ class map {
     return find_fn(key, fn);
   }
 
- private:
-  /// 用于spinlock_t 智能指针（unique_ptr）的删除器
-  struct LockDeleter {
-    void operator()(spinlock_t* l) const { l->unlock(); }
-  };
-
-  /// spinlock_t的智能指针定义
-  using LockManager = std::unique_ptr<spinlock_t, LockDeleter>;
+  /// 使用预先计算的哈希值的update_fn()，hv必须为hash_of(key)的结果
+  template <typename K, typename F>
+  bool update_fn(const hash_value& hv, const K& key, F fn) const {
+    return find_fn(hv, key, fn);
+  }
+
+  /**
+   * @brief 多个key的原子更新API接口：同时锁住所有key涉及的自旋锁，然后对所有value执行fn
+   *
+   * @tparam ForwardIt 前向迭代器类型，解引用得到待更新的键
+   * @tparam F 形如void(std::vector<mapped_type*>&)的函数类型
+   * @param first 起始迭代器
+   * @param last 终止迭代器（不包含）
+   * @param fn 对所有value进行的操作；参数中指针的顺序与keys一致，key不存在时对应的指针为nullptr
+   * @return size_type 存在于哈希表中的key的个数
+   *
+   * @note 自旋锁按照lock_ind()从小到大的顺序获取，与lock_all()的顺序一致，不会死锁；
+   *       加锁之后会重新检查hashpower，并确认每个key完整的探测序列都处于已加锁的范围内，
+   *       否则扩大加锁范围重试。fn执行期间这些key的查找、更新、删除都不会与之交错
+   * @see update_fn()
+   */
+  template <typename ForwardIt, typename F>
+  size_type multi_update_fn(ForwardIt first, ForwardIt last, F fn) {
+    using K = typename std::iterator_traits<ForwardIt>::value_type;
+    std::vector<const K*> keys;
+    std::vector<hash_value> hvs;
+    for (; first != last; ++first) {
+      keys.push_back(std::addressof(*first));
+      hvs.push_back(hashed_key(*first));
+    }
+    std::vector<mapped_type*> values(keys.size(), nullptr);
+    std::vector<size_type> stripes;
+    std::vector<LockManager> held;
+    while (true) {
+      const size_type version = layout_version();
+      const size_type hp = hashpower();
+      locks_t& locks = get_current_locks();
+      const size_type stripe_mask = locks.size() - 1;
+      stripes.clear();
+      for (const hash_value& hv : hvs) {
+        stripes.push_back(home_index(hp, hv.hash) & stripe_mask);
+      }
+      while (true) {
+        std::sort(stripes.begin(), stripes.end());
+        stripes.erase(std::unique(stripes.begin(), stripes.end()),
+                      stripes.end());
+        for (size_type s : stripes) {
+          locks[s].lock();
+          held.emplace_back(&locks[s]);
+        }
+        if (layout_version() != version) {
+          // The layout changed while taking the locks. Try again.
+          held.clear();
+          break;
+        }
+        const size_type missing = locked_multi_find_loop(
+            hp, stripe_mask, stripes, keys, hvs, values);
+        if (missing == kMaxNumLocks) {
+          size_type found = 0;
+          for (mapped_type* v : values) {
+            found += v != nullptr;
+          }
+          fn(values);
+          return found;
+        }
+        // 探测序列超出了已加锁的范围，扩大范围之后重新加锁
+        held.clear();
+        stripes.push_back(missing);
+      }
+    }
+  }
+
+  /**
+   * @brief 多个key的原子更新API接口，keys以初始化列表的形式给出
+   *
+   * @see multi_update_fn()
+   */
+  template <typename K, typename F>
+  size_type multi_update_fn(std::initializer_list<K> keys, F fn) {
+    return multi_update_fn(keys.begin(), keys.end(), fn);
+  }
+
+  /**
+   * @brief 批量插入或更新的API接口，同一组内的元素共享一次自旋锁的获取
+   *
+   * @tparam ForwardIt 前向迭代器类型，可以通过it->first, it->second访问到key和value
+   * @tparam F 形如void(mapped_type&, const V&)的函数类型，V为it->second的类型
+   * @param first 起始迭代器
+   * @param last 终止迭代器（不包含）
+   * @param fn key已经存在时对其value进行的操作，第二个参数为区间中对应的value
+   * @return size_type 新插入的元素个数
+   *
+   * @note 先计算整批key的哈希值，如果size() + 批次大小超出当前容量，则预先一次性扩容；
+   *       然后按照home bucket稳定排序（重复的key按照区间中的顺序处理），每
+   *       kUpsertBatchGroup个元素为一组，预取home bucket，按照lock_ind()从小到大的顺序
+   *       一次性锁住整组涉及的自旋锁后依次处理。探测序列超出已加锁的范围时扩大范围重新加锁，
+   *       探测次数超过hashpower时解锁并扩容。每个元素的操作是原子的，整个批次不是原子的
+   */
+  template <typename ForwardIt, typename F>
+  size_type upsert_batch(ForwardIt first, ForwardIt last, F fn) {
+    std::vector<std::pair<ForwardIt, hash_value>> entries;
+    for (; first != last; ++first) {
+      entries.emplace_back(first, hashed_key(first->first));
+    }
+    while (true) {
+      const size_type hp = hashpower();
+      const size_type new_hp = reserve_calc(size() + entries.size());
+      if (new_hp <= hp || linear_expand(hp, new_hp) == failure) {
+        break;
+      }
+    }
+    const size_type sort_hp = hashpower();
+    std::stable_sort(entries.begin(), entries.end(),
+                     [this, sort_hp](const std::pair<ForwardIt, hash_value>& a,
+                               const std::pair<ForwardIt, hash_value>& b) {
+                       return home_index(sort_hp, a.second.hash) <
+                              home_index(sort_hp, b.second.hash);
+                     });
+
+    size_type inserted = 0, next = 0;
+    std::vector<size_type> stripes;
+    std::vector<LockManager> held;
+    while (next < entries.size()) {
+      const size_type version = layout_version();
+      const size_type hp = hashpower();
+      locks_t& locks = get_current_locks();
+      const size_type stripe_mask = locks.size() - 1;
+      const size_type end =
+          std::min(entries.size(), next + size_type(kUpsertBatchGroup));
+      stripes.clear();
+      for (size_type i = next; i < end; ++i) {
+        const size_type ind = home_index(hp, entries[i].second.hash);
+        HASHMAP_PREFETCH(&buckets_[ind], 1);
+        stripes.push_back(ind & stripe_mask);
+      }
+      while (true) {
+        std::sort(stripes.begin(), stripes.end());
+        stripes.erase(std::unique(stripes.begin(), stripes.end()),
+                      stripes.end());
+        for (size_type s : stripes) {
+          locks[s].lock();
+          held.emplace_back(&locks[s]);
+        }
+        if (layout_version() != version) {
+          // The layout changed while taking the locks. Try again.
+          held.clear();
+          break;
+        }
+        table_position pos{0, ok, nullptr};
+        for (; next < end; ++next) {
+          pos = locked_upsert_one(hp, stripe_mask, stripes, entries[next].first,
+                                  entries[next].second, fn, inserted);
+          if (pos.status != ok) {
+            break;
+          }
+        }
+        held.clear();
+        if (pos.status == failure) {
+          // 探测序列超出了已加锁的范围，扩大范围之后重新加锁
+          stripes.push_back(pos.index);
+          continue;
+        } else if (pos.status == failure_under_expansion) {
+          probe_expand(version);
+        }
+        break;
+      }
+    }
+    return inserted;
+  }
+
+ private:
+  /// 用于spinlock_t 智能指针（unique_ptr）的删除器
+  struct LockDeleter {
+    void operator()(spinlock_t* l) const { l->unlock(); }
+  };
+
+  /// spinlock_t的智能指针定义
+  using LockManager = std::unique_ptr<spinlock_t, LockDeleter>;
 
   /// 通过bucket_ind获取对应的spinlock的索引，即负责管理该bucket的spinlock
   inline size_type lock_ind(const size_type bucket_ind) const {
@@ -847,11 +1658,6 @@ class map {
     LockManager lock;
   };
 
-  /// 对key进行哈希之后的哈希值
-  struct hash_value {
-    size_type hash;
-  };
-
   /// 指向rb_hashmap的智能指针(std::unique_ptr)的删除器
   struct AllUnlocker {
     void operator()(map* map) const {
@@ -872,17 +1678,32 @@ class map {
   class hashpower_changed {};
 
   /**
-   * @brief 检查哈希表当前是否正处于扩容过程中
+   * @brief 获取布局版本；调用者应当先读取布局版本，再读取hashpower并计算bucket索引
+   */
+  size_type layout_version() const {
+    return layout_version_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief 布局版本加1，在修改完hashpower、种子或自旋锁集合之后调用
+   * @pre 调用者已经通过lock_all()锁住了哈希表
+   */
+  void bump_layout_version() {
+    layout_version_.fetch_add(1, std::memory_order_release);
+  }
+
+  /**
+   * @brief 检查计算bucket索引之后哈希表的布局是否发生了变化
    *
-   * @param hp 之前记录的hashpower
+   * @param version 计算索引之前记录的布局版本（参见layout_version()）
    * @param lock 管理某个bucket的spinlock
-   * @note 判断哈希表是否正在扩容的标志是hashpower前后是否一致：如果不一致，
-   *       则表示哈希表正处于扩容中，此时解锁lock并抛hashpower_changed异常；如果一致，
-   *       则表示哈希表处于稳定状态；哈希表扩容时hashpower会加1，哈希表容量为原来的2倍
+   * @note 扩容、缩容、更换种子、更换自旋锁集合都会使布局版本加1；其中更换种子可能
+   *       不改变hashpower，收缩之后hashpower也可能回到之前的值，因此不能只比较hashpower。
+   *       布局版本不一致时解锁lock并抛hashpower_changed异常，调用者重新计算索引
    * @pre lock处于被锁定的状态
    */
-  inline void check_hashpower(size_type hp, spinlock_t& lock) const {
-    if (hashpower() != hp) {
+  inline void check_layout(size_type version, spinlock_t& lock) const {
+    if (layout_version_.load(std::memory_order_relaxed) != version) {
       lock.unlock();
       throw hashpower_changed();
     }
@@ -891,18 +1712,18 @@ class map {
   /**
    * @brief 尝试对特定的bucket上锁
    *
-   * @param hp 加锁前拿到的hashpower
+   * @param version 计算索引之前拿到的布局版本
    * @param i bucket的索引值
    * @return spinlock_t* 指向自旋锁的指针（该锁处于锁定的状态）
    */
-  spinlock_t* lock_one(size_type hp, size_type i) const {
+  spinlock_t* lock_one(size_type version, size_type i) const {
     locks_t& locks = get_current_locks();
     const size_type l = lock_ind(i);
     assert(l < kMaxNumLocks);
     spinlock_t& lock = locks[l];
     lock.lock();
     assert(!lock.try_lock());
-    check_hashpower(hp, lock);
+    check_layout(version, lock);
     return &lock;
   }
 
@@ -910,24 +1731,26 @@ class map {
    * @brief 将指定的bucket锁住，loop的含义是处理lock_one()可能的失败情况，
    *        在循环体中执行lock_one，直到获得特定bucket的访问权限
    *
+   * @param version 加锁前拿到的布局版本
    * @param hp 加锁前拿到的hashpower
    * @param ind bucket的索引值
-   * @param retry_counter 重试次数；如果发生哈希表扩容则会被复位
+   * @param retry_counter 重试次数；如果哈希表布局发生变化则会被复位
    * @param hv 对Key进行哈希得到的哈希值
    * @return LockManager 对lock_one返回的自旋锁构造的智能指针（unique_ptr）
    * @see lock_one()
    */
-  LockManager lock_one_loop(size_type& hp, size_type& ind,
+  LockManager lock_one_loop(size_type& version, size_type& hp, size_type& ind,
                             size_type& retry_counter,
                             const hash_value& hv) const {
     while (true) {
       try {
-        spinlock_t* lock = lock_one(hp, ind);
+        spinlock_t* lock = lock_one(version, ind);
         return LockManager(lock);
       } catch (hashpower_changed&) {
-        // The hashpower changed while taking the locks. Try again.
+        // The layout changed while taking the locks. Try again.
+        version = layout_version();
         hp = hashpower();
-        ind = index_hash(hp, hv.hash);
+        ind = home_index(hp, hv.hash);
         retry_counter = 0;
       }
     }
@@ -968,11 +1791,12 @@ class map {
    */
   template <typename K>
   table_position linear_find_loop(const K& key, const hash_value& hv) const {
-    size_type retry_counter = 0, hp = hashpower();
-    size_type ind = index_hash(hp, hv.hash);
+    size_type retry_counter = 0, version = layout_version();
+    size_type hp = hashpower();
+    size_type ind = home_index(hp, hv.hash);
     while (true) {
       // retry_counter will be reset when hashtable is under expansion
-      LockManager lock = lock_one_loop(hp, ind, retry_counter, hv);
+      LockManager lock = lock_one_loop(version, hp, ind, retry_counter, hv);
       auto& b = buckets_[ind];
       if (!b.occupied()) {
         return {0, failure_key_not_found, nullptr};
@@ -1001,10 +1825,11 @@ class map {
    * @see linear_find_loop()
    */
   template <typename K>
-  table_position locked_linear_find_loop(const K& key) const {
+  table_position locked_linear_find_loop(const K& key_arg) const {
+    const auto& key = lookup_key(key_arg);
     const hash_value hv = hashed_key(key);
     size_type retry_counter = 0, hp = hashpower();
-    size_type ind = index_hash(hp, hv.hash);
+    size_type ind = home_index(hp, hv.hash);
     while (true) {
       auto& b = buckets_[ind];
       if (!b.occupied()) {
@@ -1023,6 +1848,119 @@ class map {
     return {0, failure_key_not_found, nullptr};
   }
 
+  /**
+   * @brief 在已经持有部分自旋锁的情况下，查找多个key所在的位置
+   *
+   * @param hp 加锁前拿到的hashpower
+   * @param stripe_mask 当前自旋锁集合大小减1
+   * @param stripes 已经加锁的自旋锁索引（有序）
+   * @param keys 待查找的键
+   * @param hvs 待查找键的哈希值
+   * @param values 查找结果，key不存在时为nullptr
+   * @return size_type 某个key的探测序列经过了未加锁的bucket时，返回该bucket对应的自旋锁
+   *         索引；所有key的探测序列都处于已加锁的范围内时，返回kMaxNumLocks
+   */
+  template <typename K>
+  size_type locked_multi_find_loop(size_type hp, size_type stripe_mask,
+                                   const std::vector<size_type>& stripes,
+                                   const std::vector<const K*>& keys,
+                                   const std::vector<hash_value>& hvs,
+                                   std::vector<mapped_type*>& values) {
+    for (size_type i = 0; i < keys.size(); ++i) {
+      values[i] = nullptr;
+      size_type retry_counter = 0;
+      size_type ind = home_index(hp, hvs[i].hash);
+      while (true) {
+        const size_type stripe = ind & stripe_mask;
+        if (!std::binary_search(stripes.begin(), stripes.end(), stripe)) {
+          return stripe;
+        }
+        auto& b = buckets_[ind];
+        if (!b.occupied()) {
+          break;
+        } else if (b.deleted()) {
+          // deleted flag act as tombstone
+        } else if (keq_eq()(b.key(), *keys[i])) {
+          values[i] = &b.mapped();
+          break;
+        }
+        // worst case of linear search
+        if (++retry_counter >= hp) {
+          break;
+        }
+        ind = index_hash(hp, ++ind);
+      }
+    }
+    return kMaxNumLocks;
+  }
+
+  /**
+   * @brief upsert_batch()的辅助函数，在已经持有部分自旋锁的情况下插入或更新一个元素
+   *
+   * @param hp 加锁前拿到的hashpower
+   * @param stripe_mask 当前自旋锁集合大小减1
+   * @param stripes 已经加锁的自旋锁索引（有序）
+   * @param inserted 插入成功时加1
+   * @return table_position ok表示已完成插入或更新；failure表示探测序列经过了未加锁的
+   *         bucket，index为该bucket对应的自旋锁索引；failure_under_expansion表示探测次数
+   *         超过了hashpower，需要扩容
+   */
+  template <typename It, typename F>
+  table_position locked_upsert_one(size_type hp, size_type stripe_mask,
+                                   const std::vector<size_type>& stripes,
+                                   It it, const hash_value& hv, F& fn,
+                                   size_type& inserted) {
+    size_type retry_counter = 0;
+    size_type ind = home_index(hp, hv.hash);
+    while (true) {
+      const size_type stripe = ind & stripe_mask;
+      if (!std::binary_search(stripes.begin(), stripes.end(), stripe)) {
+        return {stripe, failure, nullptr};
+      }
+      auto& b = buckets_[ind];
+      if (!b.occupied() || b.deleted()) {
+        add_to_bucket(ind, hv, it->first, it->second);
+        ++inserted;
+        return {ind, ok, nullptr};
+      } else if (keq_eq()(b.key(), it->first)) {
+        fn(b.mapped(), it->second);
+        return {ind, ok, nullptr};
+      }
+      ind = index_hash(hp, ++ind);
+      if (++retry_counter >= hp) {
+        return {0, failure_under_expansion, nullptr};
+      }
+    }
+  }
+
+  /**
+   * @brief scan()的辅助函数，访问探测窗口内所有以home为home bucket的元素
+   *
+   * @note 元素只会被放置在距离home bucket不超过hp的位置，且从home bucket到该元素之间的
+   *       bucket都处于occupied状态（删除只设置deleted标志），因此遇到空bucket即可结束
+   * @throw hashpower_changed 访问期间哈希表的布局发生了变化（扩容、收缩或者更换种子）
+   */
+  template <typename F>
+  size_type scan_home_bucket(size_type version, size_type hp, size_type home,
+                             F& fn) {
+    size_type emitted = 0, retry_counter = 0, ind = home;
+    while (true) {
+      LockManager lock(lock_one(version, ind));
+      auto& b = buckets_[ind];
+      if (!b.occupied()) {
+        break;
+      } else if (!b.deleted() && home_index(hp, b.hash()) == home) {
+        fn(b.key(), b.mapped());
+        ++emitted;
+      }
+      if (++retry_counter >= hp) {
+        break;
+      }
+      ind = index_hash(hp, ++ind);
+    }
+    return emitted;
+  }
+
   /**
    * @brief 使用线性探测法对哈希表进行插入操作的辅助函数
    *
@@ -1034,10 +1972,11 @@ class map {
   template <typename K>
   table_position linear_insert_loop(K const& key, const hash_value& hv) {
     size_type retry_counter = 0;
+    size_type version = layout_version();
     size_type hp = hashpower();
-    size_type ind = index_hash(hp, hv.hash);
+    size_type ind = home_index(hp, hv.hash);
     while (true) {
-      LockManager lock = lock_one_loop(hp, ind, retry_counter, hv);
+      LockManager lock = lock_one_loop(version, hp, ind, retry_counter, hv);
       assert(!lock->try_lock());
       auto& b = buckets_[ind];
       if (!b.occupied() || b.deleted()) {
@@ -1048,30 +1987,227 @@ class map {
       ind = index_hash(hp, ++ind);
       if (++retry_counter >= hp) {
         lock.reset();
-        linear_expand(hp, hp + 1);
+        probe_expand(version);
+        version = layout_version();
+        hp = hashpower();
+        ind = home_index(hp, hv.hash);
+        retry_counter = 0;
+      }
+    }
+    return {0, failure, nullptr};
+  }
+
+  /**
+   * @brief 在哈希表被锁住（调用过lock_all()）的情况下，查找key可插入的位置
+   *
+   * @return table_position 位置信息和错误码，结果中的锁总是为空
+   * @note 探测次数超过hashpower时直接在当前线程中扩容，不需要重新加锁
+   * @see linear_insert_loop()
+   */
+  template <typename K>
+  table_position locked_linear_insert_loop(K const& key, const hash_value& hv) {
+    size_type retry_counter = 0;
+    size_type hp = hashpower();
+    size_type ind = home_index(hp, hv.hash);
+    while (true) {
+      auto& b = buckets_[ind];
+      if (!b.occupied() || b.deleted()) {
+        return {ind, ok, nullptr};
+      } else if (keq_eq()(b.key(), key)) {
+        return {ind, failure_key_duplicated, nullptr};
+      }
+      ind = index_hash(hp, ++ind);
+      if (++retry_counter >= hp) {
+        locked_probe_expand(hp);
         hp = hashpower();
-        ind = index_hash(hp, hv.hash);
+        ind = home_index(hp, hv.hash);
         retry_counter = 0;
       }
     }
     return {0, failure, nullptr};
   }
 
+  /**
+   * @brief 在哈希表被锁住的情况下插入一个元素，需要扩容时直接在当前线程中完成
+   * @return true 插入成功
+   * @return false key已经存在
+   */
+  template <typename K, typename... Args>
+  bool locked_insert(const hash_value& hv, K&& key, Args&&... val) {
+    const table_position pos = locked_linear_insert_loop(key, hv);
+    if (pos.status != ok) {
+      return false;
+    }
+    add_to_bucket(pos.index, hv, std::forward<K>(key),
+                  std::forward<Args>(val)...);
+    return true;
+  }
+
+  /// insert_bulk()的辅助函数，逐个插入
+  template <typename InputIt>
+  size_type locked_insert_bulk(InputIt first, InputIt last,
+                               std::input_iterator_tag) {
+    size_type inserted = 0;
+    for (; first != last; ++first) {
+      inserted += locked_insert(hashed_key(first->first), first->first,
+                                first->second);
+    }
+    return inserted;
+  }
+
+  /// insert_bulk()的辅助函数，根据区间长度预留空间后逐个插入
+  template <typename ForwardIt>
+  size_type locked_insert_bulk(ForwardIt first, ForwardIt last,
+                               std::forward_iterator_tag) {
+    locked_reserve(size() + std::distance(first, last));
+    return locked_insert_bulk(first, last, std::input_iterator_tag());
+  }
+
+  /// insert_bulk()的辅助函数，预留空间后并行计算哈希值并按照bucket区间并行放置
+  template <typename RandomIt>
+  size_type locked_insert_bulk(RandomIt first, RandomIt last,
+                               std::random_access_iterator_tag) {
+    const size_type n = static_cast<size_type>(last - first);
+    locked_reserve(size() + n);
+    const size_type num_parts = 1 + max_num_worker_threads();
+    const size_type hp = hashpower();
+    if (num_parts == 1 || n < kMinParallelBulkSize ||
+        hashsize(hp) < num_parts * hp) {
+      return locked_insert_bulk(first, last, std::input_iterator_tag());
+    }
+
+    // 1. 并行计算哈希值
+    std::vector<size_type> hashes(n);
+    parallel_exec(0, n,
+                  [&](size_type i, size_type end, std::exception_ptr& eptr) {
+                    try {
+                      for (; i < end; ++i) {
+                        hashes[i] = hashed_key((first + i)->first).hash;
+                      }
+                    } catch (...) {
+                      eptr = std::current_exception();
+                    }
+                  });
+
+    // 2. 按照home bucket所在的区间对元素进行稳定的计数排序，保证重复key时先出现的胜出
+    const size_type span = (hashsize(hp) + num_parts - 1) / num_parts;
+    std::vector<size_type> offsets(num_parts + 1, 0);
+    for (size_type i = 0; i < n; ++i) {
+      ++offsets[home_index(hp, hashes[i]) / span + 1];
+    }
+    for (size_type p = 0; p < num_parts; ++p) {
+      offsets[p + 1] += offsets[p];
+    }
+    std::vector<size_type> order(n);
+    {
+      std::vector<size_type> cursors(offsets.begin(), offsets.end() - 1);
+      for (size_type i = 0; i < n; ++i) {
+        order[cursors[home_index(hp, hashes[i]) / span]++] = i;
+      }
+    }
+
+    // 3. 每个线程只在自己负责的bucket区间内放置元素，元素计数先记录在线程私有的数组中
+    const size_type orig_size = size();
+    const size_type num_locks = get_current_locks().size();
+    std::vector<std::vector<counter_type>> counters(
+        num_parts, std::vector<counter_type>(num_locks, 0));
+    std::vector<std::vector<size_type>> deferred(num_parts);
+    auto merge_counters = [&]() {
+      locks_t& locks = get_current_locks();
+      for (auto& part : counters) {
+        for (size_type l = 0; l < num_locks; ++l) {
+          locks[l].elem_counter() += part[l];
+        }
+      }
+    };
+    try {
+      parallel_exec(
+          0, num_parts,
+          [&](size_type p, size_type p_end, std::exception_ptr& eptr) {
+            try {
+              for (; p < p_end; ++p) {
+                const size_type lo = p * span;
+                const size_type hi = std::min(lo + span, hashsize(hp));
+                for (size_type k = offsets[p]; k < offsets[p + 1]; ++k) {
+                  const size_type i = order[k];
+                  const table_position pos =
+                      bounded_insert_pos(hp, hi, hashes[i], (first + i)->first);
+                  if (pos.status == failure) {
+                    deferred[p].push_back(i);
+                  } else if (pos.status == ok) {
+                    buckets_.setKV(pos.index, (first + i)->first,
+                                   (first + i)->second);
+                    buckets_[pos.index].hash() = hashes[i];
+                    ++counters[p][lock_ind(pos.index)];
+                  }
+                }
+              }
+            } catch (...) {
+              eptr = std::current_exception();
+            }
+          });
+    } catch (...) {
+      merge_counters();
+      throw;
+    }
+    merge_counters();
+
+    // 4. 探测越过区间边界的元素，由当前线程补充插入
+    for (auto& part : deferred) {
+      for (size_type i : part) {
+        locked_insert(hash_value{hashes[i]}, (first + i)->first,
+                      (first + i)->second);
+      }
+    }
+    return size() - orig_size;
+  }
+
+  /**
+   * @brief insert_bulk()的辅助函数，在[home, hi)区间内查找key可插入的位置
+   *
+   * @return table_position ok表示可以插入；failure_key_duplicated表示key已经存在；
+   *         failure表示探测越过了区间边界或者探测次数超过hashpower，需要补充插入
+   */
+  template <typename K>
+  table_position bounded_insert_pos(size_type hp, size_type hi,
+                                    size_type hash, const K& key) const {
+    size_type ind = home_index(hp, hash);
+    for (size_type retry_counter = 0; retry_counter < hp; ++retry_counter) {
+      const auto& b = buckets_[ind];
+      if (!b.occupied() || b.deleted()) {
+        return {ind, ok, nullptr};
+      } else if (keq_eq()(b.key(), key)) {
+        return {ind, failure_key_duplicated, nullptr};
+      }
+      if (++ind == hi) {
+        break;
+      }
+    }
+    return {0, failure, nullptr};
+  }
+
+  /// 在哈希表被锁住的情况下预留能容纳n个key-value对的空间，不会缩容
+  void locked_reserve(size_type n) {
+    const size_type new_hp = reserve_calc(n);
+    if (new_hp > hashpower()) {
+      locked_expand(new_hp);
+    }
+  }
+
   /**
    * @brief 更新/插入/删除操作真正的实现，如果fn返回true则删除指定的键值对
    *
    * @see upsert()
    */
   template <typename K, typename F, typename... Args>
-  bool uprase_fn(K&& key, F fn, Args&&... val) {
-    hash_value hv = hashed_key(key);
+  bool uprase_fn(const hash_value& hv, K&& key, F fn, Args&&... val) {
     table_position pos = linear_insert_loop(key, hv);
     assert(pos.status != failure);
     if (pos.status == ok) {
       // insert
       assert(pos.lock != nullptr);
       assert(!pos.lock->try_lock());
-      add_to_bucket(pos.index, std::forward<K>(key),
+      add_to_bucket(pos.index, hv, std::forward<K>(key),
                     std::forward<Args>(val)...);
     } else {
       // update or erase
@@ -1095,8 +2231,14 @@ class map {
    */
   template <typename K, typename F>
   bool erase_fn(const K& key, F fn) {
-    const hash_value hv = hashed_key(key);
-    table_position pos = linear_find_loop(key, hv);
+    const auto& k = lookup_key(key);
+    return erase_fn(hashed_key(k), k, fn);
+  }
+
+  /// 使用预先计算的哈希值的删除辅助函数
+  template <typename K, typename F>
+  bool erase_fn(const hash_value& hv, const K& key, F fn) {
+    table_position pos = linear_find_loop(lookup_key(key), hv);
     if (pos.status == ok) {
       if (fn(buckets_[pos.index].mapped())) {
         del_from_bucket(pos.index);
@@ -1113,16 +2255,52 @@ class map {
    * @tparam K 待插入的键（Key）类型
    * @tparam Args 用于构造关联value的参数的类型
    * @param bucket_ind bucket索引值
+   * @param hv key的哈希值，保存在bucket中
    * @param key 待插入的具体键（key）
    * @param val 用于构造关联value的参数
    */
   template <typename K, typename... Args>
-  void add_to_bucket(const size_type bucket_ind, K&& key, Args&&... val) {
+  void add_to_bucket(const size_type bucket_ind, const hash_value& hv, K&& key,
+                     Args&&... val) {
     buckets_.setKV(bucket_ind, std::forward<K>(key),
                    std::forward<Args>(val)...);
+    buckets_[bucket_ind].hash() = hv.hash;
+    ++get_current_locks()[lock_ind(bucket_ind)].elem_counter();
+  }
+
+  /// 键和值都可以按字节拷贝时，迁移元素直接整体拷贝bucket
+  using is_trivially_migratable = std::integral_constant<
+      bool, std::is_trivially_copyable<key_type>::value &&
+                std::is_trivially_copyable<mapped_type>::value>;
+
+  /**
+   * @brief locked_expand()的辅助函数，将旧表中的元素b放入本表（新表）
+   *
+   * @param b 旧表中有效的bucket，迁移之后其中的键值对可能处于被移动的状态
+   * @param rehash_keys 是否重新计算key的哈希值，否则使用b中保存的哈希值
+   */
+  void migrate_from(typename buckets_t::bucket& b, bool rehash_keys) {
+    const hash_value hv =
+        rehash_keys ? hashed_key(b.key()) : hash_value{b.hash()};
+    table_position pos = linear_insert_loop(b.key(), hv);
+    if (pos.status != ok) {
+      return;
+    }
+    migrate_to_bucket(pos.index, hv, b, is_trivially_migratable());
+  }
+
+  void migrate_to_bucket(const size_type bucket_ind, const hash_value& hv,
+                         typename buckets_t::bucket& b, std::true_type) {
+    buckets_.copyKV(bucket_ind, b);
+    buckets_[bucket_ind].hash() = hv.hash;
     ++get_current_locks()[lock_ind(bucket_ind)].elem_counter();
   }
 
+  void migrate_to_bucket(const size_type bucket_ind, const hash_value& hv,
+                         typename buckets_t::bucket& b, std::false_type) {
+    add_to_bucket(bucket_ind, hv, b.movable_key(), b.movable_mapped());
+  }
+
   /// 从内部存储（buckets）中删除指定索引处的键值对
   void del_from_bucket(const size_type bucket_ind) {
     buckets_.eraseKV(bucket_ind);
@@ -1151,6 +2329,7 @@ class map {
       lock.elem_counter() = 0;
       lock.is_migrated() = true;
     }
+    bump_layout_version();
   }
 
   /// 并行执行辅助函数，用于哈希表扩容时均分迁移任务给多个线程执行
@@ -1206,9 +2385,40 @@ class map {
     return blog2;
   }
 
+  /**
+   * @brief 查找时可以直接使用K类型的key：哈希函数和相等函数都支持异构查找，或者K就是
+   *        key_type，或者K不能隐式转换为key_type（由哈希函数和相等函数自行处理K）；
+   *        否则先把key转换为key_type，避免哈希以及每次比较都构造一个临时对象
+   */
+  template <typename K>
+  using is_direct_lookup = std::integral_constant<
+      bool, (is_transparent<hasher>::value &&
+             is_transparent<key_equal>::value) ||
+                std::is_same<typename std::decay<K>::type, key_type>::value ||
+                !std::is_convertible<const K&, key_type>::value>;
+
+  /// 返回查找使用的key，不支持异构查找时转换为key_type（只转换一次）
+  template <typename K>
+  typename std::conditional<is_direct_lookup<K>::value, const K&,
+                            key_type>::type
+  lookup_key(const K& key) const {
+    return lookup_key(key, is_direct_lookup<K>());
+  }
+
+  template <typename K>
+  static const K& lookup_key(const K& key, std::true_type) {
+    return key;
+  }
+
+  template <typename K>
+  static key_type lookup_key(const K& key, std::false_type) {
+    return key;
+  }
+
   template <typename K>
   hash_value hashed_key(const K& key) const {
-    const size_type hash = hash_function()(key);
+    const size_type hash = static_cast<size_type>(
+        mix_hash(mixer_, static_cast<uint64_t>(hash_function()(key))));
     return {hash};
   }
 
@@ -1224,8 +2434,62 @@ class map {
     return hv & hashmask(hp);
   }
 
+  /**
+   * @brief 计算哈希值为hv的key的home bucket；设置了种子时先用种子打散哈希值
+   *
+   * @note 调用者先读取布局版本和hp再调用本函数；种子和hashpower都在布局版本加1之前
+   *       写入，因此加锁之后check_layout()通过即说明计算索引时使用的hp和种子仍然有效
+   */
+  size_type home_index(const size_type hp, const size_type hv) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t seed = seed_.load(std::memory_order_relaxed);
+    if (seed == 0) {
+      return index_hash(hp, hv);
+    }
+    return index_hash(hp, static_cast<size_type>(mix_hash(
+                              hash_mixer::murmur, hv ^ seed)));
+  }
+
+  /// 工具函数，按位逆序
+  static size_type reverse_bits(size_type v) {
+    size_type s = sizeof(v) * 8;
+    size_type mask = ~size_type(0);
+    while ((s >>= 1) > 0) {
+      mask ^= (mask << s);
+      v = ((v >> s) & mask) | ((v << s) & ~mask);
+    }
+    return v;
+  }
+
+  /// 工具函数，返回不小于n的最小的2的幂
+  static size_type next_pow2(const size_type n) {
+    return hashsize(reserve_calc(n));
+  }
+
+  /// 计算拥有bucket_cnt个bucket的哈希表应当使用的自旋锁数目
+  size_type lock_count(size_type bucket_cnt) const {
+    return std::min(bucket_cnt, max_num_locks_);
+  }
+
+  /**
+   * @brief 扩容/缩容完成后更新自旋锁集合
+   *
+   * @param new_bucket_count 新的bucket数目
+   * @param new_locks 新哈希表的自旋锁集合，其中保存了迁移后的元素计数
+   * @note 如果锁数目不变，则直接复用当前的自旋锁集合（已被lock_all()锁住），
+   *       仅同步元素计数，避免每次扩容都重新申请和拷贝自旋锁
+   * @pre 调用者已经通过lock_all()锁住了当前的自旋锁集合
+   */
   void maybe_resize_locks(size_type new_bucket_count, locks_t& new_locks) {
-    locks_t next_locks(std::min(size_type(kMaxNumLocks), new_bucket_count));
+    assert(new_locks.size() == lock_count(new_bucket_count));
+    locks_t& current_locks = get_current_locks();
+    if (current_locks.size() == new_locks.size()) {
+      for (size_type i = 0; i < new_locks.size(); ++i) {
+        current_locks[i] = new_locks[i];
+      }
+      return;
+    }
+    locks_t next_locks(new_locks.size());
     std::copy(new_locks.begin(), new_locks.end(), next_locks.begin());
     for (spinlock_t& lock : next_locks) {
       lock.lock();
@@ -1233,26 +2497,95 @@ class map {
     all_locks_.emplace_back(std::move(next_locks));
   }
 
+  /**
+   * @brief 探测次数超过hashpower时触发的扩容
+   *
+   * @param orig_version 探测时使用的布局版本；布局已经变化时直接返回，由调用者重新探测
+   * @see locked_probe_expand()
+   */
+  op_status probe_expand(size_type orig_version) {
+    auto all_locks_manager = lock_all();
+    if (!all_locks_manager) return failure;
+
+    if (layout_version() != orig_version) {
+      return failure_under_expansion;
+    }
+    locked_probe_expand(hashpower());
+    return ok;
+  }
+
+  /**
+   * @brief 探测次数超过hashpower时的扩容，同时检测针对bucket索引的哈希冲突攻击
+   *
+   * @details 正常情况下探测过长意味着表已经接近满载；如果连续两次因为探测过长而扩容时
+   *          负载率都低于kFloodLoadFactor，说明大量key落在了同一段bucket上，继续翻倍
+   *          只会浪费内存。此时不再翻倍，而是在原hashpower上换用新的随机种子重新放置所有
+   *          元素，打散冲突的key。负载率恢复之前只更换一次种子，之后仍然按翻倍处理，保证
+   *          完全相同的哈希值也能最终插入成功
+   * @note 种子作用于Hash的结果（参见home_index()），因此只能防御bucket索引层面的冲突；
+   *       构造Hash完全碰撞的攻击在换种子之后仍然冲突，只能依靠翻倍扩容
+   * @note 原hashpower上的重新放置对正在进行的操作是安全的：它们在加锁之后通过
+   *       check_layout()比较布局版本，而不是hashpower
+   * @pre 调用者已经通过lock_all()锁住了哈希表
+   */
+  void locked_probe_expand(size_type hp) {
+    if (load_factor() >= kFloodLoadFactor) {
+      sparse_expansions_ = 0;
+    } else if (++sparse_expansions_ == 2) {
+      ++nr_reseed;
+      locked_expand(hp, random_seed());
+      return;
+    }
+    locked_expand(hp + 1);
+  }
+
   op_status linear_expand(size_type orig_hp, size_type new_hp) {
     auto all_locks_manager = lock_all();
     if (!all_locks_manager) return failure;
 
+    if (hashpower() != orig_hp) {
+      return failure_under_expansion;
+    }
+    locked_expand(new_hp);
+    return ok;
+  }
+
+  /**
+   * @brief 扩容或缩容的实现，将所有元素迁移到hashpower为new_hp的新表中
+   * @pre 调用者已经通过lock_all()锁住了哈希表
+   */
+  void locked_expand(size_type new_hp) { locked_expand(new_hp, seed()); }
+
+  /**
+   * @brief 扩容或缩容，并使用新的种子new_seed重新放置所有元素
+   *
+   * @param rehash_keys 为true时重新计算每个key的哈希值（混合策略发生了变化）；
+   *               否则直接使用bucket中保存的哈希值
+   */
+  void locked_expand(size_type new_hp, uint64_t new_seed,
+                     bool rehash_keys = false) {
     ++nr_expand_or_shrink;
     const size_type hp = hashpower();
-    if (hp != orig_hp) {
-      return failure_under_expansion;
+    if (new_hp == hp + 1 && new_seed == seed() && !rehash_keys &&
+        locked_expand_in_place(new_hp, is_trivially_migratable())) {
+      ++nr_expand_in_place;
+      bump_layout_version();
+      return;
     }
-    map new_map(new_hp);
+    map new_map(new_hp, hash_fn_, eq_fn_);
     new_map.max_num_worker_threads(max_num_worker_threads());
+    new_map.max_num_locks(max_num_locks());
+    new_map.mixer_ = mixer_;
+    new_map.seed_.store(new_seed, std::memory_order_relaxed);
     parallel_exec(
         0, hashsize(hp),
-        [this, &new_map](size_type i, size_type end, std::exception_ptr& eptr) {
+        [this, &new_map, rehash_keys](size_type i, size_type end,
+                                 std::exception_ptr& eptr) {
           try {
             for (; i < end; ++i) {
               auto& bucket = buckets_[i];
               if (bucket.occupied() && !bucket.deleted()) {
-                new_map.insert(bucket.movable_key(),
-                               std::move(bucket.mapped()));
+                new_map.migrate_from(bucket, rehash_keys);
               }
             }
           } catch (...) {
@@ -1260,10 +2593,147 @@ class map {
           }
         });
     maybe_resize_locks(new_map.bucket_count(), new_map.get_current_locks());
+    // 种子先于hashpower生效，参见home_index()
+    seed_.store(new_map.seed(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
     buckets_.swap(new_map.buckets_);
-    return ok;
+    bump_layout_version();
   }
 
+  /**
+   * @brief 通过table::remap()原地将容量翻倍，避免同时持有新旧两个bucket数组
+   *
+   * @details 翻倍只增加了一个哈希位，元素的home bucket要么不变（h），要么变为h + N
+   *          （N为原容量）。以原表中的空bucket为边界把原表划分为若干段，每个线程按照位置
+   *          顺序处理一段：取出元素之后从新的home bucket开始探测，放入第一个空bucket。
+   *          留在低半区的元素只会向前移动，不会越过尚未处理的元素；移到高半区的元素离
+   *          home bucket的距离也不会超过原来的距离，因此不会越过本段的边界。作为保护，
+   *          探测到其他线程负责的区域、尚未处理的位置或者超过探测窗口时，元素暂存起来，
+   *          在所有线程结束后按照普通插入放回。删除标志在处理过程中被一并清除
+   * @return false 不支持原地扩容（数组不是通过mmap申请的、mremap失败或者原表中没有
+   *         空bucket），调用者需要迁移到新表
+   * @pre 调用者已经通过lock_all()锁住了哈希表，且new_hp == hashpower() + 1
+   */
+  bool locked_expand_in_place(size_type new_hp, std::true_type) {
+    using bucket_t = typename buckets_t::bucket;
+    const size_type old_size = hashsize(hashpower());
+    if (!buckets_t::mapped(hashpower())) {
+      return false;
+    }
+
+    // 1. 每段从一个空bucket开始，按照线程数目均分
+    const size_type num_parts = 1 + max_num_worker_threads();
+    std::vector<size_type> starts;
+    for (size_type p = 0; p < num_parts; ++p) {
+      size_type i = std::max(p * (old_size / num_parts),
+                             starts.empty() ? 0 : starts.back() + 1);
+      while (i < old_size && buckets_[i].occupied()) {
+        ++i;
+      }
+      if (i == old_size) {
+        break;
+      }
+      starts.push_back(i);
+    }
+    if (starts.empty()) {
+      return false;
+    }
+
+    // 拆分用到的内存都在remap之前申请，暂存区按照每段的长度预留，拆分过程中不会因为
+    // 申请内存失败而留下拆分了一半的表；预留的内存只有真正暂存元素时才会被访问
+    const size_type lock_mask = lock_count(hashsize(new_hp)) - 1;
+    std::vector<std::vector<counter_type>> counters(
+        starts.size(), std::vector<counter_type>(lock_mask + 1, 0));
+    locks_t new_locks(lock_mask + 1);
+    std::vector<std::vector<bucket_t>> deferred(starts.size());
+    for (size_type part = 0; part < starts.size(); ++part) {
+      const size_type end =
+          part + 1 < starts.size() ? starts[part + 1] : starts[0] + old_size;
+      deferred[part].reserve(end - starts[part]);
+    }
+    if (!buckets_.remap(new_hp)) {
+      return false;
+    }
+
+    // 2. 并行拆分，每个线程只访问原位置以及高半区对应位置属于本段的bucket
+    const size_type new_mask = hashmask(new_hp);
+    const size_type old_mask = old_size - 1;
+    parallel_exec(
+        0, starts.size(),
+        [&](size_type part, size_type part_end, std::exception_ptr& eptr) {
+          try {
+            for (; part < part_end; ++part) {
+              const size_type begin = starts[part];
+              const size_type len =
+                  (part + 1 < starts.size() ? starts[part + 1] : starts[0]) -
+                  begin + (part + 1 < starts.size() ? 0 : old_size);
+              // 相对本段起点的偏移，不属于本段的位置偏移不小于len
+              auto offset = [&](size_type ind) {
+                return ((ind & old_mask) - begin) & old_mask;
+              };
+              for (size_type k = 1; k < len; ++k) {
+                const size_type pos = (begin + k) & old_mask;
+                bucket_t& b = buckets_[pos];
+                if (!b.occupied()) {
+                  continue;
+                } else if (b.deleted()) {
+                  b.occupied() = false;
+                  b.deleted() = false;
+                  continue;
+                }
+                size_type ind = home_index(new_hp, b.hash());
+                if (ind == pos) {
+                  ++counters[part][pos & lock_mask];
+                  continue;
+                }
+                bucket_t tmp;
+                memcpy(static_cast<void*>(&tmp), static_cast<const void*>(&b),
+                       sizeof(bucket_t));
+                b.occupied() = false;
+                for (size_type retry_counter = 0;; ++retry_counter) {
+                  if (retry_counter >= new_hp || offset(ind) >= len ||
+                      (ind < old_size && offset(ind) > k)) {
+                    deferred[part].push_back(tmp);
+                    break;
+                  }
+                  if (!buckets_[ind].occupied()) {
+                    memcpy(static_cast<void*>(&buckets_[ind]),
+                           static_cast<const void*>(&tmp), sizeof(bucket_t));
+                    ++counters[part][ind & lock_mask];
+                    break;
+                  }
+                  ind = (ind + 1) & new_mask;
+                }
+              }
+            }
+          } catch (...) {
+            eptr = std::current_exception();
+          }
+        });
+
+    // 3. 更新自旋锁的元素计数，之后再公开新的hashpower
+    for (auto& part : counters) {
+      for (size_type l = 0; l <= lock_mask; ++l) {
+        new_locks[l].elem_counter() += part[l];
+      }
+    }
+    maybe_resize_locks(hashsize(new_hp), new_locks);
+    std::atomic_thread_fence(std::memory_order_release);
+    buckets_.hashpower(new_hp);
+
+    // 4. 放回暂存的元素
+    for (auto& part : deferred) {
+      for (bucket_t& b : part) {
+        const hash_value hv{b.hash()};
+        const table_position pos = locked_linear_insert_loop(b.key(), hv);
+        migrate_to_bucket(pos.index, hv, b, std::true_type());
+      }
+    }
+    return true;
+  }
+
+  bool locked_expand_in_place(size_type, std::false_type) { return false; }
+
   /// 哈希函数
   hasher hash_fn_;
   /// 判别key是否相等的相等函数
@@ -1276,11 +2746,25 @@ class map {
   mutable buckets_t old_buckets_;
   /// 保存扩容时可启动的线程数
   std::atomic<size_type> max_num_worker_threads_;
+  /// 允许使用的最大自旋锁数目（2的幂）
+  size_type max_num_locks_;
+  /// 对哈希函数结果的混合策略
+  hash_mixer mixer_;
+  /// 计算bucket索引时使用的种子，0表示不使用种子
+  std::atomic<uint64_t> seed_;
+  /// 布局版本，元素的位置（hashpower、种子）或者自旋锁集合每变化一次加1
+  std::atomic<size_type> layout_version_;
+  /// 连续的、负载率低于kFloodLoadFactor的探测扩容次数
+  size_type sparse_expansions_ = 0;
 
   /// 用于debug的统计数据，扩容或缩容次数
   uint64_t nr_expand_or_shrink = 0;
   /// 用于debug的统计数据，清空次数
   uint64_t nr_clear = 0;
+  /// 用于debug的统计数据，检测到哈希冲突攻击后更换种子的次数
+  uint64_t nr_reseed = 0;
+  /// 用于debug的统计数据，通过mremap原地扩容的次数
+  uint64_t nr_expand_in_place = 0;
 
  public:
   class locked_table {
@@ -1321,6 +2805,8 @@ class map {
       reference operator*() const { return (*buckets_)[index_].kvpair(); }
       /// 箭头操作符
       pointer operator->() const { return std::addressof(operator*()); }
+      /// 获取当前元素的key，Value为key_only时只能通过该接口访问元素
+      const key_type& key() const { return (*buckets_)[index_].key(); }
       /// 前置++操作符
       const_iterator& operator++() {
         ++index_;
@@ -1476,14 +2962,243 @@ class map {
     /// 返回指向最后一个元素后面的const迭代器（按照存储顺序）
     const_iterator cend() const { return end(); }
 
+    /**
+     * @brief 使用多个线程并行地对所有键值对执行fn，线程数由max_num_worker_threads()决定
+     *
+     * @tparam F 形如void(const key_type&, mapped_type&)的函数类型
+     * @param fn 对每个键值对进行的操作，会被多个线程同时调用
+     * @note 任务按照bucket区间均分给各个线程，与扩容时的数据迁移相同
+     */
+    template <typename F>
+    void parallel_for_each(F fn) {
+      parallel_buckets([&fn](bucket& b) {
+        fn(b.key(), b.mapped());
+      });
+    }
+
+    /**
+     * @brief 使用多个线程并行地对所有键值对进行归约，线程数由max_num_worker_threads()决定
+     *
+     * @tparam T 归约结果的类型
+     * @tparam MapF 形如T(const key_type&, const mapped_type&)的函数类型
+     * @tparam ReduceF 形如T(T, T)的函数类型，需要满足结合律和交换律
+     * @param init 归约的初始值，只参与一次归约
+     * @param map_fn 将每个键值对映射为T
+     * @param reduce_fn 合并两个T
+     * @return T 归约结果，哈希表为空时返回init
+     */
+    template <typename T, typename MapF, typename ReduceF>
+    T parallel_reduce(T init, MapF map_fn, ReduceF reduce_fn) const {
+      std::mutex result_mutex;
+      // 工作线程只读取seed，init只在result_mutex保护下被修改
+      const T seed = init;
+      parallel_chunks(
+          [&](size_type i, size_type end) {
+            const buckets_t& buckets = map_.get().buckets_;
+            T local = seed;
+            bool has_local = false;
+            for (; i < end; ++i) {
+              const bucket& b = buckets[i];
+              if (!b.occupied() || b.deleted()) {
+                continue;
+              }
+              if (has_local) {
+                local = reduce_fn(std::move(local), map_fn(b.key(), b.mapped()));
+              } else {
+                local = map_fn(b.key(), b.mapped());
+                has_local = true;
+              }
+            }
+            if (has_local) {
+              std::lock_guard<std::mutex> guard(result_mutex);
+              init = reduce_fn(std::move(init), std::move(local));
+            }
+          });
+      return init;
+    }
+
+    /**
+     * @brief 查找key，不需要再对bucket加锁
+     * @return iterator 指向key所在位置的迭代器；key不存在时返回end()
+     */
+    template <typename K>
+    iterator find(const K& key) {
+      const auto pos = map_.get().locked_linear_find_loop(key);
+      return pos.status == ok ? iterator(map_.get().buckets_, pos.index)
+                              : end();
+    }
+
+    /// 查找key，返回const迭代器
+    template <typename K>
+    const_iterator find(const K& key) const {
+      const auto pos = map_.get().locked_linear_find_loop(key);
+      return pos.status == ok ? const_iterator(map_.get().buckets_, pos.index)
+                              : end();
+    }
+
+    /// 返回key在哈希表中的个数（0或1）
+    template <typename K>
+    size_type count(const K& key) const {
+      return map_.get().locked_linear_find_loop(key).status == ok ? 1 : 0;
+    }
+
+    /**
+     * @brief 插入键值对，不需要再对bucket加锁；需要扩容时直接在当前线程中完成
+     *
+     * @return std::pair<iterator, bool> 指向key所在位置的迭代器，以及是否插入成功；
+     *         key已经存在时不修改原有的value，返回false
+     */
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> insert(K&& key, Args&&... val) {
+      map& m = map_.get();
+      const hash_value hv = m.hashed_key(key);
+      const auto pos = m.locked_linear_insert_loop(key, hv);
+      if (pos.status == ok) {
+        m.add_to_bucket(pos.index, hv, std::forward<K>(key),
+                        std::forward<Args>(val)...);
+      }
+      return std::make_pair(iterator(m.buckets_, pos.index), pos.status == ok);
+    }
+
+    /// 与insert()相同
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> emplace(K&& key, Args&&... val) {
+      return insert(std::forward<K>(key), std::forward<Args>(val)...);
+    }
+
+    /**
+     * @brief 删除key，不需要再对bucket加锁
+     * @return size_type 被删除的元素个数（0或1）
+     */
+    template <typename K>
+    size_type erase(const K& key) {
+      const auto pos = map_.get().locked_linear_find_loop(key);
+      if (pos.status != ok) {
+        return 0;
+      }
+      map_.get().del_from_bucket(pos.index);
+      return 1;
+    }
+
+    /// 删除迭代器指向的元素，返回指向下一个元素的迭代器
+    iterator erase(iterator pos) {
+      assert(pos.buckets_ == std::addressof(map_.get().buckets_));
+      map_.get().del_from_bucket(pos.index_);
+      return ++pos;
+    }
+
+    /// 返回key关联的value的引用，key不存在时插入默认构造的value
+    template <typename K>
+    mapped_type& operator[](K&& key) {
+      return insert(std::forward<K>(key)).first->second;
+    }
+
    private:
+    using bucket = typename buckets_t::bucket;
+
     locked_table(map& map) noexcept
         : map_(map), all_locks_manager_(map.lock_all()) {}
 
+    /// 使用parallel_exec()将bucket区间均分给多个线程，fn(i, end)处理[i, end)
+    template <typename F>
+    void parallel_chunks(F fn) const {
+      map& m = map_.get();
+      m.parallel_exec(
+          0, m.buckets_.size(),
+          [&fn](size_type i, size_type end, std::exception_ptr& eptr) {
+            try {
+              fn(i, end);
+            } catch (...) {
+              eptr = std::current_exception();
+            }
+          });
+    }
+
+    /// 并行地对每个有效的bucket执行fn(bucket)
+    template <typename F>
+    void parallel_buckets(F fn) {
+      parallel_chunks([this, &fn](size_type i, size_type end) {
+        buckets_t& buckets = map_.get().buckets_;
+        for (; i < end; ++i) {
+          bucket& b = buckets[i];
+          if (b.occupied() && !b.deleted()) {
+            fn(b);
+          }
+        }
+      });
+    }
+
     std::reference_wrapper<map> map_;
     AllLocksManager all_locks_manager_;
     friend class map;
   };
+
+  /**
+   * @brief 访问句柄：持有单个元素所在bucket的自旋锁，在原地访问键值对
+   *
+   * @tparam IsConst 为true时只能读取value
+   * @note 句柄只能移动不能拷贝；空句柄不持有任何锁
+   * @see find_ptr()
+   */
+  template <bool IsConst>
+  class basic_locked_ptr {
+   public:
+    using value_type =
+        typename std::conditional<IsConst, const typename map::value_type,
+                                  typename map::value_type>::type;
+    using mapped_type =
+        typename std::conditional<IsConst, const typename map::mapped_type,
+                                  typename map::mapped_type>::type;
+
+    /// 构造空句柄
+    basic_locked_ptr() = default;
+    /// 移动构造函数，other变为空句柄
+    basic_locked_ptr(basic_locked_ptr&& other) noexcept
+        : lock_(std::move(other.lock_)), kvpair_(other.kvpair_) {
+      other.kvpair_ = nullptr;
+    }
+    /// 移动赋值操作符，先释放当前持有的自旋锁，other变为空句柄
+    basic_locked_ptr& operator=(basic_locked_ptr&& other) noexcept {
+      lock_ = std::move(other.lock_);
+      kvpair_ = other.kvpair_;
+      other.kvpair_ = nullptr;
+      return *this;
+    }
+    basic_locked_ptr(const basic_locked_ptr&) = delete;
+    basic_locked_ptr& operator=(const basic_locked_ptr&) = delete;
+
+    /// 句柄是否指向某个元素
+    explicit operator bool() const { return kvpair_ != nullptr; }
+    /// 句柄是否为空
+    bool empty() const { return kvpair_ == nullptr; }
+
+    /// 获取key，句柄不能为空
+    const key_type& key() const {
+      assert(kvpair_ != nullptr);
+      return kvpair_->first;
+    }
+    /// 获取value的引用，句柄不能为空
+    mapped_type& operator*() const {
+      assert(kvpair_ != nullptr);
+      return kvpair_->second;
+    }
+    /// 访问value的成员，句柄不能为空
+    mapped_type* operator->() const { return std::addressof(operator*()); }
+
+    /// 释放自旋锁，句柄变为空
+    void reset() {
+      kvpair_ = nullptr;
+      lock_.reset();
+    }
+
+   private:
+    basic_locked_ptr(LockManager lock, value_type* kvpair)
+        : lock_(std::move(lock)), kvpair_(kvpair) {}
+
+    LockManager lock_;
+    value_type* kvpair_ = nullptr;
+    friend class map;
+  };
 };
 
 }  // namespace rbhash
\ No newline at end of file
@@ -0,0 +1,696 @@
+// Copyright (c) 2020 The rbhash Authors. All rights reserved.
+
+#pragma once
+
+#include "rbhash.hpp"
+
+#include <memory>
+
+namespace rbhash {
+
+/**
+ * @brief 读多写少场景下的RCU（read-copy-update）哈希表，底层使用table保存每个版本的数据
+ *
+ * @details
+ * 读者通过原子指针获取当前发布的不可变版本（version）并直接查找，不获取任何锁，
+ *          也不修改任何共享数据；写者之间使用互斥锁串行化，每次修改都拷贝当前版本得到新版本，
+ *          在新版本上批量执行修改（modify()），完成后原子地发布新版本。被替换的旧版本按照epoch
+ *          进行回收：每个读者线程在第一次访问时注册一个自己独占缓存行的读者槽（reader slot），
+ *          之后访问版本前只需把全局epoch写入自己的槽；写者只释放那些所有登记的读者都不可能
+ *          再访问的旧版本。读者槽随线程数增加，线程退出时归还以便复用，读者永远不会阻塞。
+ *
+ * @note 每次修改的代价为O(n)，适用于路由表、配置表等读写比极高的场景；
+ *       多个修改应当通过modify()合并为一个批次，以减少拷贝次数
+ *
+ * @tparam Key 哈希表中存储的键类型
+ * @tparam Value 哈希表中存储的值类型
+ * @tparam Hash 哈希函数，默认使用std::hash<Key>
+ * @tparam KeyEqual 判断Key是否相等的相等函数，默认使用std::equal_to<Key>
+ * @tparam Allocator 自定义Allocator，默认使用std::allocator<std::pair<const
+ * Key, Value>>
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>>
+class rcu_map {
+ public:
+  /// 定义buckets_t类型为Table类型别名
+  using buckets_t = table<Key, Value, Allocator>;
+  /// 和标准库类似，定义key_type，这里直接使用Table中的定义
+  using key_type = typename buckets_t::key_type;
+  /// 和标准库类似，定义mapped_type，这里直接使用Table中的定义
+  using mapped_type = typename buckets_t::mapped_type;
+  /// 和标准库类似，定义value_type，这里直接使用Table中定义
+  using value_type = typename buckets_t::value_type;
+  /// 定义size_type，这里直接使用Table中的定义
+  using size_type = typename buckets_t::size_type;
+  /// 和标准库类似，这里直接使用Table中的定义
+  using allocator_type = typename buckets_t::allocator_type;
+  /// 定义hasher为模板参数Hash函数的别名
+  using hasher = Hash;
+  /// 定义key_equal为模板参数KeyEqual函数的别名
+  using key_equal = KeyEqual;
+
+  /// 前向声明writer类型，表示一个正在构造中的新版本
+  class writer;
+
+  static_assert(std::is_copy_constructible<Key>::value &&
+                    std::is_copy_constructible<Value>::value,
+                "rcu_map requires copy constructible key and value");
+
+  /**
+   * @brief 构造给定容量的rcu_map，初始状态为空
+   *
+   * @param hp （hashpower）哈希表的初始容量（容量大小为2^hashpower）
+   * @param hf 哈希函数
+   * @param eq_f 相等函数，用于判断key值是否相等
+   */
+  explicit rcu_map(size_type hp = HASHMAP_DEFAULT_HASHPOWER,
+                   const Hash& hf = Hash(), const KeyEqual& eq_f = KeyEqual(),
+                   const Allocator& alloc = Allocator())
+      : hash_fn_(hf),
+        eq_fn_(eq_f),
+        allocator_(alloc),
+        version_allocator_(allocator_),
+        epoch_(1),
+        map_id_(next_map_id()),
+        readers_(std::make_shared<reader_registry>()) {
+    current_.store(create_version(hp), std::memory_order_release);
+  }
+
+  /**
+   * @brief rcu_map不支持拷贝和移动
+   */
+  rcu_map(rcu_map const&) = delete;
+  rcu_map& operator=(rcu_map const&) = delete;
+
+  /**
+   * @brief 析构函数，释放当前版本以及所有尚未回收的旧版本
+   */
+  ~rcu_map() {
+    destroy_version(current_.load(std::memory_order_acquire));
+    for (auto& retired : retired_) {
+      destroy_version(retired.first);
+    }
+  }
+
+  /// 获取哈希函数
+  hasher hash_function() const { return hash_fn_; }
+
+  /// 获取key比较函数
+  key_equal key_eq() const { return eq_fn_; }
+
+  /// 获取当前版本的hashpower
+  size_type hashpower() const {
+    read_guard guard(*this);
+    return guard->buckets.hashpower();
+  }
+
+  /// 获取当前版本中bucket的数量
+  size_type bucket_count() const { return hashsize(hashpower()); }
+
+  /// 获取哈希表的容量
+  size_type capacity() const { return bucket_count(); }
+
+  /// 获取当前版本的大小
+  size_type size() const {
+    read_guard guard(*this);
+    return guard->size;
+  }
+
+  /// 判断哈希表当前是否为空
+  bool empty() const { return size() == 0; }
+
+  /// 获取哈希表的负载情况
+  double load_factor() const {
+    read_guard guard(*this);
+    return static_cast<double>(guard->size) /
+           static_cast<double>(guard->buckets.size());
+  }
+
+  /// 估算哈希表占用内存大小（包括尚未回收的旧版本），字节数
+  size_type footprint() const {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    size_type bytes = readers_->count.load(std::memory_order_relaxed) *
+                          sizeof(reader_slot) +
+                      current_.load(std::memory_order_acquire)
+                          ->buckets.footprint() +
+                      sizeof(version);
+    for (auto& retired : retired_) {
+      bytes += retired.first->buckets.footprint() + sizeof(version);
+    }
+    return bytes;
+  }
+
+  /**
+   * @brief Key-Value查找的API接口，不获取任何锁
+   *
+   * @param key 待查找的具体键（key）值
+   * @param val 如果key在哈希表中，键key所关联的value值
+   * @return true key存在于哈希表中
+   * @return false key不在哈希表中
+   */
+  template <typename K>
+  bool find(const K& key, mapped_type& val) const {
+    return find_fn(key, [&val](const mapped_type& v) { val = v; });
+  }
+
+  /**
+   * @brief Key-Value查找的API接口，不获取任何锁
+   *
+   * @return mapped_type 在表中key所关联的value值
+   * @note 如果key不存在表中，则会抛std::out_of_range异常
+   */
+  template <typename K>
+  mapped_type find(const K& key) const {
+    const size_type hv = hash_fn_(key);
+    read_guard guard(*this);
+    const size_type ind = find_index(guard->buckets, key, hv);
+    if (ind == npos) {
+      throw std::out_of_range("key not found");
+    }
+    return guard->buckets[ind].mapped();
+  }
+
+  /// 判断key是否存在于当前版本中
+  template <typename K>
+  bool contains(const K& key) const {
+    return find_fn(key, [](const mapped_type&) {});
+  }
+
+  /**
+   * @brief 查找API的辅助函数，不获取任何锁
+   *
+   * @param key 待查找的具体键（key）
+   * @param fn 对key所关联的value进行的只读操作，执行期间该版本不会被回收
+   * @return true key在哈希表中，执行fn指定的操作
+   * @return false key不在哈希表中
+   */
+  template <typename K, typename F>
+  bool find_fn(const K& key, F fn) const {
+    const size_type hv = hash_fn_(key);
+    read_guard guard(*this);
+    const size_type ind = find_index(guard->buckets, key, hv);
+    if (ind == npos) {
+      return false;
+    }
+    fn(guard->buckets[ind].mapped());
+    return true;
+  }
+
+  /**
+   * @brief 批量修改接口：拷贝当前版本，在新版本上执行fn，完成后发布新版本
+   *
+   * @tparam F 形如void(writer&)的函数
+   * @param fn 对新版本进行修改的函数；如果fn抛出异常，则放弃新版本，当前版本保持不变
+   */
+  template <typename F>
+  void modify(F fn) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    writer w(*this, copy_version(*current_.load(std::memory_order_acquire)));
+    fn(w);
+    publish(w.release());
+  }
+
+  /**
+   * @brief Key-Value插入操作的API接口，相当于只包含一次插入的modify()
+   *
+   * @return true 插入成功
+   * @return false key已经存在，插入失败
+   */
+  template <typename K, typename... Args>
+  bool insert(K&& key, Args&&... val) {
+    bool ret = false;
+    modify([&](writer& w) {
+      ret = w.insert(std::forward<K>(key), std::forward<Args>(val)...);
+    });
+    return ret;
+  }
+
+  /**
+   * @brief 插入或者修改API接口，相当于只包含一次insert_or_assign的modify()
+   *
+   * @return true key不存在，插入成功
+   * @return false key已经存在，value被修改
+   */
+  template <typename K, typename V>
+  bool insert_or_assign(K&& key, V&& val) {
+    bool ret = false;
+    modify([&](writer& w) {
+      ret = w.insert_or_assign(std::forward<K>(key), std::forward<V>(val));
+    });
+    return ret;
+  }
+
+  /**
+   * @brief 删除Key的API接口，相当于只包含一次删除的modify()
+   *
+   * @return true 删除成功
+   * @return false key不存在
+   */
+  template <typename K>
+  bool erase(const K& key) {
+    bool ret = false;
+    modify([&](writer& w) { ret = w.erase(key); });
+    return ret;
+  }
+
+  /**
+   * @brief 回收所有读者都不再访问的旧版本；写者每次发布新版本后会自动调用
+   */
+  void reclaim() {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    reclaim_retired();
+  }
+
+  /**
+   * @brief 正在构造中的新版本，只能在modify()的回调中使用，仅对当前写者可见
+   */
+  class writer {
+   public:
+    writer(const writer&) = delete;
+    writer& operator=(const writer&) = delete;
+
+    ~writer() {
+      if (version_ != nullptr) {
+        map_.destroy_version(version_);
+      }
+    }
+
+    /// 新版本的当前大小
+    size_type size() const { return version_->size; }
+
+    /**
+     * @brief 在新版本中插入键值对
+     *
+     * @return true 插入成功
+     * @return false key已经存在，插入失败
+     */
+    template <typename K, typename... Args>
+    bool insert(K&& key, Args&&... val) {
+      const size_type hv = map_.hash_fn_(key);
+      if (map_.find_index(version_->buckets, key, hv) != npos) {
+        return false;
+      }
+      add(hv, std::forward<K>(key), std::forward<Args>(val)...);
+      return true;
+    }
+
+    /**
+     * @brief 在新版本中插入或者修改键值对
+     *
+     * @return true key不存在，插入成功
+     * @return false key已经存在，value被修改
+     */
+    template <typename K, typename V>
+    bool insert_or_assign(K&& key, V&& val) {
+      const size_type hv = map_.hash_fn_(key);
+      const size_type ind = map_.find_index(version_->buckets, key, hv);
+      if (ind != npos) {
+        version_->buckets[ind].mapped() = std::forward<V>(val);
+        return false;
+      }
+      add(hv, std::forward<K>(key), std::forward<V>(val));
+      return true;
+    }
+
+    /// 在新版本中删除key，返回key是否存在
+    template <typename K>
+    bool erase(const K& key) {
+      const size_type ind =
+          map_.find_index(version_->buckets, key, map_.hash_fn_(key));
+      if (ind == npos) {
+        return false;
+      }
+      version_->buckets.eraseKV(ind);
+      --version_->size;
+      return true;
+    }
+
+    /// 在新版本中对key关联的value执行fn，返回key是否存在
+    template <typename K, typename F>
+    bool update_fn(const K& key, F fn) {
+      const size_type ind =
+          map_.find_index(version_->buckets, key, map_.hash_fn_(key));
+      if (ind == npos) {
+        return false;
+      }
+      fn(version_->buckets[ind].mapped());
+      return true;
+    }
+
+    /// 在新版本中查找key，并对其关联的value执行只读操作fn
+    template <typename K, typename F>
+    bool find_fn(const K& key, F fn) const {
+      const size_type ind =
+          map_.find_index(version_->buckets, key, map_.hash_fn_(key));
+      if (ind == npos) {
+        return false;
+      }
+      fn(static_cast<const buckets_t&>(version_->buckets)[ind].mapped());
+      return true;
+    }
+
+   private:
+    friend class rcu_map;
+
+    writer(rcu_map& map, typename rcu_map::version* v)
+        : map_(map), version_(v) {}
+
+    /// 交出新版本的所有权，用于发布
+    typename rcu_map::version* release() {
+      typename rcu_map::version* v = version_;
+      version_ = nullptr;
+      return v;
+    }
+
+    /// 插入一个确定不存在的key，负载超过一半时先扩容
+    template <typename K, typename... Args>
+    void add(size_type hv, K&& key, Args&&... val) {
+      if (2 * (version_->used + 1) > version_->buckets.size()) {
+        typename rcu_map::version* bigger = map_.copy_version(*version_);
+        map_.destroy_version(version_);
+        version_ = bigger;
+      }
+      map_.place(*version_, hv, std::forward<K>(key),
+                 std::forward<Args>(val)...);
+    }
+
+    rcu_map& map_;
+    typename rcu_map::version* version_;
+  };
+
+ private:
+  /// 一个不可变的版本，发布之后只允许读取
+  struct version {
+    version(size_type hp, const allocator_type& alloc)
+        : buckets(hp, alloc), size(0), used(0) {}
+
+    /// 保存键值对的table
+    buckets_t buckets;
+    /// 有效元素个数
+    size_type size;
+    /// 被占用的bucket个数（包括删除标记），用于控制探测长度
+    size_type used;
+  };
+
+  /// 读者槽，独占一个缓存行，同一时刻只属于一个线程
+  struct alignas(64) reader_slot {
+    explicit reader_slot(void* r) noexcept
+        : epoch(0), owned(true), next(nullptr), raw(r) {}
+    /// 0表示读者不在访问版本，否则为读者登记的epoch
+    std::atomic<uint64_t> epoch;
+    /// 是否被某个线程占有，线程退出时清除
+    std::atomic<bool> owned;
+    /// 注册表中的下一个读者槽
+    reader_slot* next;
+    /// 申请得到的原始地址（C++17之前new不保证按照缓存行对齐）
+    void* raw;
+  };
+
+  /**
+   * @brief 读者槽的注册表，读者槽组成只在头部插入的链表，注册表析构时才释放
+   *
+   * @note 注册表由哈希表和读者线程共享（shared_ptr/weak_ptr），哈希表析构之后退出的
+   *       线程不会再访问它；读者槽使用全局的operator new申请，与哈希表的allocator无关
+   */
+  struct reader_registry {
+    reader_registry() noexcept : head(nullptr), count(0) {}
+    ~reader_registry() {
+      reader_slot* s = head.load(std::memory_order_acquire);
+      while (s != nullptr) {
+        reader_slot* next = s->next;
+        void* raw = s->raw;
+        s->~reader_slot();
+        ::operator delete(raw);
+        s = next;
+      }
+    }
+
+    /// 占有一个空闲的读者槽，没有空闲槽时注册一个新的
+    reader_slot* acquire() {
+      for (reader_slot* s = head.load(std::memory_order_acquire); s != nullptr;
+           s = s->next) {
+        bool expected = false;
+        if (!s->owned.load(std::memory_order_relaxed) &&
+            s->owned.compare_exchange_strong(expected, true,
+                                             std::memory_order_acq_rel)) {
+          return s;
+        }
+      }
+      void* raw = ::operator new(sizeof(reader_slot) + alignof(reader_slot));
+      void* p = reinterpret_cast<void*>(
+          (reinterpret_cast<uintptr_t>(raw) + alignof(reader_slot) - 1) &
+          ~(uintptr_t(alignof(reader_slot)) - 1));
+      reader_slot* s = new (p) reader_slot(raw);
+      s->next = head.load(std::memory_order_relaxed);
+      while (!head.compare_exchange_weak(s->next, s, std::memory_order_release,
+                                         std::memory_order_relaxed)) {
+      }
+      count.fetch_add(1, std::memory_order_relaxed);
+      return s;
+    }
+
+    std::atomic<reader_slot*> head;
+    /// 注册的读者槽个数
+    std::atomic<size_type> count;
+  };
+
+  /// 线程在某个rcu_map中占有的读者槽
+  struct reader_entry {
+    /// 所属rcu_map的编号（地址可能被复用，编号不会）
+    uint64_t map_id;
+    std::weak_ptr<reader_registry> registry;
+    reader_slot* slot;
+    /// read_guard的嵌套层数，只有最外层负责登记和清除epoch
+    size_type depth;
+  };
+
+  /// 线程占有的所有读者槽，线程退出时归还给仍然存在的rcu_map
+  struct thread_readers {
+    ~thread_readers() {
+      for (auto& entry : entries) {
+        if (auto registry = entry->registry.lock()) {
+          entry->slot->owned.store(false, std::memory_order_release);
+        }
+      }
+    }
+
+    /// 元素通过指针保存，read_guard持有的指针不会因为插入或删除而失效
+    std::vector<std::unique_ptr<reader_entry>> entries;
+  };
+
+  /// 读者访问版本期间持有的守卫，析构时清除登记的epoch
+  class read_guard {
+   public:
+    explicit read_guard(const rcu_map& map) : entry_(map.pin()) {
+      version_ = map.current_.load(std::memory_order_seq_cst);
+    }
+    ~read_guard() {
+      if (--entry_->depth == 0) {
+        entry_->slot->epoch.store(0, std::memory_order_release);
+      }
+    }
+
+    read_guard(const read_guard&) = delete;
+    read_guard& operator=(const read_guard&) = delete;
+
+    const version* operator->() const { return version_; }
+
+   private:
+    reader_entry* entry_;
+    const version* version_;
+  };
+
+  template <typename U>
+  using rebind_alloc =
+      typename std::allocator_traits<allocator_type>::template rebind_alloc<U>;
+
+  /// 表示查找失败的索引值
+  static constexpr size_type npos = ~size_type(0);
+
+  static inline size_type hashsize(const size_type hp) {
+    return size_type(1) << hp;
+  }
+
+  static inline size_type hashmask(const size_type hp) {
+    return hashsize(hp) - 1;
+  }
+
+  static inline size_type index_hash(const size_type hp, const size_type hv) {
+    return hv & hashmask(hp);
+  }
+
+  /// 为每个rcu_map分配一个不会重复的编号
+  static uint64_t next_map_id() {
+    static std::atomic<uint64_t> id(0);
+    return id.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  /// 获取当前线程在本哈希表中的读者槽，第一次访问时注册
+  reader_entry& local_reader() const {
+    static thread_local thread_readers readers;
+    auto& entries = readers.entries;
+    for (auto& entry : entries) {
+      if (entry->map_id == map_id_) {
+        return *entry;
+      }
+    }
+    // 顺便清理已经析构的哈希表留下的记录
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [](const std::unique_ptr<reader_entry>& e) {
+                                   return e->registry.expired();
+                                 }),
+                  entries.end());
+    std::unique_ptr<reader_entry> entry(new reader_entry);
+    entry->map_id = map_id_;
+    entry->registry = readers_;
+    entry->slot = readers_->acquire();
+    entry->depth = 0;
+    entries.push_back(std::move(entry));
+    return *entries.back();
+  }
+
+  /**
+   * @brief 读者登记：把当前epoch写入本线程独占的读者槽
+   *
+   * @note 读者槽只属于当前线程，使用普通的store加上seq_cst fence即可，与写者的
+   *       current_.exchange()和读取读者槽构成store-load的同步：要么写者看到登记的epoch，
+   *       要么读者读到新发布的版本；登记的epoch可能小于实际的全局epoch，这只会让回收更加保守
+   */
+  reader_entry* pin() const {
+    reader_entry& entry = local_reader();
+    if (entry.depth++ == 0) {
+      entry.slot->epoch.store(epoch_.load(std::memory_order_acquire),
+                              std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    return &entry;
+  }
+
+  version* create_version(size_type hp) {
+    version* v = version_allocator_.allocate(1);
+    std::allocator_traits<rebind_alloc<version>>::construct(version_allocator_,
+                                                             v, hp, allocator_);
+    return v;
+  }
+
+  void destroy_version(version* v) noexcept {
+    std::allocator_traits<rebind_alloc<version>>::destroy(version_allocator_, v);
+    version_allocator_.deallocate(v, 1);
+  }
+
+  /// 拷贝一个版本中的有效元素（去掉删除标记），新版本的负载不超过一半
+  version* copy_version(const version& from) {
+    size_type hp = from.buckets.hashpower();
+    while (hashsize(hp) < 2 * (from.size + 1)) {
+      ++hp;
+    }
+    version* v = create_version(hp);
+    try {
+      for (size_type i = 0; i < from.buckets.size(); ++i) {
+        const auto& b = from.buckets[i];
+        if (b.occupied() && !b.deleted()) {
+          place(*v, hash_fn_(b.key()), b.key(), b.mapped());
+        }
+      }
+    } catch (...) {
+      destroy_version(v);
+      throw;
+    }
+    return v;
+  }
+
+  /// 在版本v中查找key，返回bucket索引，找不到返回npos
+  template <typename K>
+  size_type find_index(const buckets_t& buckets, const K& key,
+                       size_type hv) const {
+    const size_type hp = buckets.hashpower();
+    size_type ind = index_hash(hp, hv);
+    for (size_type probes = 0; probes < buckets.size(); ++probes) {
+      const auto& b = buckets[ind];
+      if (!b.occupied()) {
+        return npos;
+      } else if (!b.deleted() && eq_fn_(b.key(), key)) {
+        return ind;
+      }
+      ind = index_hash(hp, ind + 1);
+    }
+    return npos;
+  }
+
+  /// 在版本v中放置一个确定不存在的键值对，优先复用删除标记所在的bucket
+  template <typename K, typename... Args>
+  void place(version& v, size_type hv, K&& key, Args&&... val) {
+    const size_type hp = v.buckets.hashpower();
+    size_type ind = index_hash(hp, hv);
+    while (v.buckets[ind].occupied() && !v.buckets[ind].deleted()) {
+      ind = index_hash(hp, ind + 1);
+    }
+    if (!v.buckets[ind].occupied()) {
+      ++v.used;
+    }
+    v.buckets.setKV(ind, std::forward<K>(key), std::forward<Args>(val)...);
+    ++v.size;
+  }
+
+  /// 发布新版本，并把旧版本加入待回收列表
+  void publish(version* v) {
+    version* old = current_.exchange(v, std::memory_order_seq_cst);
+    const uint64_t retired_at =
+        epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+    retired_.emplace_back(old, retired_at);
+    reclaim_retired();
+  }
+
+  /**
+   * @brief 回收旧版本
+   *
+   * @note 在epoch e被回收的版本，只可能被登记epoch小于e的读者访问：登记epoch不小于e的读者
+   *       一定是在新版本发布之后才读取current_的
+   * @pre 调用者持有writer_mutex_
+   */
+  void reclaim_retired() {
+    uint64_t min_active = std::numeric_limits<uint64_t>::max();
+    for (const reader_slot* slot =
+             readers_->head.load(std::memory_order_acquire);
+         slot != nullptr; slot = slot->next) {
+      const uint64_t e = slot->epoch.load(std::memory_order_seq_cst);
+      if (e != 0 && e < min_active) {
+        min_active = e;
+      }
+    }
+    auto it = retired_.begin();
+    while (it != retired_.end()) {
+      if (it->second <= min_active) {
+        destroy_version(it->first);
+        it = retired_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  /// 哈希函数
+  hasher hash_fn_;
+  /// 判别key是否相等的相等函数
+  key_equal eq_fn_;
+  /// 用于构造table的allocator
+  allocator_type allocator_;
+  /// 用于申请版本结构的allocator
+  rebind_alloc<version> version_allocator_;
+  /// 当前发布的版本
+  std::atomic<version*> current_;
+  /// 全局epoch，每发布一个新版本加1
+  std::atomic<uint64_t> epoch_;
+  /// 本哈希表的编号，用于在线程的读者槽记录中查找
+  const uint64_t map_id_;
+  /// 读者槽的注册表
+  std::shared_ptr<reader_registry> readers_;
+  /// 串行化写者
+  mutable std::mutex writer_mutex_;
+  /// 等待回收的旧版本以及其被替换时的epoch
+  std::vector<std::pair<version*, uint64_t>> retired_;
+};
+
+}  // namespace rbhash
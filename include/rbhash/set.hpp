@@ -0,0 +1,345 @@
+// Copyright (c) 2020 The rbhash Authors. All rights reserved.
+
+#pragma once
+
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "rbhash.hpp"
+
+namespace rbhash {
+
+/**
+ * @brief 并发线程安全的哈希集合，只保存key
+ *
+ * @details
+ * 底层是Value为key_only的map：与map使用相同的自旋锁分段、线性探测、扩容和locked_table，
+ *          但bucket中只有key、标志位和哈希值，不为value预留存储和pair的填充。
+ *          例如key为uint64_t时每个bucket为24字节，而map<uint64_t, bool>为32字节
+ *
+ * @tparam Key 集合中存储的键类型
+ * @tparam Hash 哈希函数，默认使用std::hash<Key>
+ * @tparam KeyEqual 判断Key是否相等的相等函数，默认使用std::equal_to<Key>
+ * @tparam Allocator 自定义Allocator，默认使用std::allocator<Key>
+ */
+template <typename Key, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          typename Allocator = std::allocator<Key>>
+class set {
+ public:
+  /// 底层map的类型
+  using map_type =
+      map<Key, key_only, Hash, KeyEqual,
+          typename std::allocator_traits<Allocator>::template rebind_alloc<
+              std::pair<const Key, key_only>>>;
+  /// 和标准库类似，定义key_type，这里直接使用map中的定义
+  using key_type = typename map_type::key_type;
+  /// 和标准库类似，集合的value_type与key_type相同
+  using value_type = key_type;
+  /// 定义size_type，这里直接使用map中的定义
+  using size_type = typename map_type::size_type;
+  /// 和标准库类似，定义迭代器差值类型
+  using difference_type = std::ptrdiff_t;
+  /// 定义hasher为模板参数Hash函数的别名
+  using hasher = Hash;
+  /// 定义key_equal为模板参数KeyEqual函数的别名
+  using key_equal = KeyEqual;
+  /// 预先计算的哈希值，与map使用相同的定义
+  using hash_value = typename map_type::hash_value;
+
+  /// 前向声明locked_table类型，表示锁定状态的集合
+  class locked_table;
+
+  /**
+   * @brief 构造给定容量的set，初始状态为空
+   *
+   * @param hp （hashpower）哈希表的初始容量（容量大小为2^hashpower）
+   * @param hf 哈希函数
+   * @param eq_f 相等函数，用于判断key值是否相等
+   */
+  explicit set(size_type hp = HASHMAP_DEFAULT_HASHPOWER,
+               const Hash& hf = Hash(), const KeyEqual& eq_f = KeyEqual(),
+               const Allocator& alloc = Allocator())
+      : map_(hp, hf, eq_f, alloc) {}
+
+  /**
+   * @brief set不支持拷贝构造和拷贝赋值
+   */
+  set(set const&) = delete;
+  set& operator=(set const&) = delete;
+
+  /// 获取哈希函数
+  hasher hash_function() const { return map_.hash_function(); }
+
+  /// 获取hashpower
+  size_type hashpower() const { return map_.hashpower(); }
+
+  /// 获取bucket的数量
+  size_type bucket_count() const { return map_.bucket_count(); }
+
+  /// 获取集合的容量
+  size_type capacity() const { return map_.capacity(); }
+
+  /// 获取集合的当前大小
+  size_type size() const { return map_.size(); }
+
+  /// 判断集合当前是否为空
+  bool empty() const { return map_.empty(); }
+
+  /// 获取集合的负载情况
+  double load_factor() const { return map_.load_factor(); }
+
+  /// 估算集合占用内存大小，字节数
+  size_type footprint() const { return map_.footprint(); }
+
+  /// 设置扩容时允许启动的额外线程数
+  void max_num_worker_threads(size_type extra_threads) {
+    map_.max_num_worker_threads(extra_threads);
+  }
+
+  /**
+   * @brief 设置对哈希函数结果的混合策略
+   * @note 非线程安全，必须在集合被多个线程共享之前调用
+   */
+  void mixer(hash_mixer m) { map_.mixer(m); }
+
+  /// 获取当前使用的混合策略
+  hash_mixer mixer() const { return map_.mixer(); }
+
+  /// 计算key的哈希值，结果可以传给接受哈希值的重载
+  template <typename K>
+  hash_value hash_of(const K& key) const {
+    return map_.hash_of(key);
+  }
+
+  /**
+   * @brief 插入key
+   *
+   * @return true key原先不存在，插入成功
+   * @return false key已经存在
+   */
+  template <typename K>
+  bool insert(K&& key) {
+    return map_.insert(std::forward<K>(key));
+  }
+
+  /// 使用预先计算的哈希值进行插入，hv必须为hash_of(key)的结果
+  template <typename K>
+  bool insert(const hash_value& hv, K&& key) {
+    return map_.insert(hv, std::forward<K>(key));
+  }
+
+  /// 判断key是否存在
+  template <typename K>
+  bool contains(const K& key) const {
+    return map_.find_fn(key, [](const key_only&) {});
+  }
+
+  /// 使用预先计算的哈希值判断key是否存在
+  template <typename K>
+  bool contains(const hash_value& hv, const K& key) const {
+    return map_.find_fn(hv, key, [](const key_only&) {});
+  }
+
+  /**
+   * @brief 批量判断key是否存在
+   *
+   * @param keys 待查找的key数组
+   * @param n key的个数
+   * @param found_mask 位图，至少(n + 63) / 64个元素；key存在时第i位置1，否则置0
+   * @return size_type 存在于集合中的key的个数
+   * @see map::find_batch()
+   */
+  template <typename K>
+  size_type contains_batch(const K* keys, size_type n,
+                           uint64_t* found_mask) const {
+    return map_.find_batch(keys, n, nullptr, found_mask);
+  }
+
+  /**
+   * @brief 删除key
+   *
+   * @return true key存在，删除成功
+   * @return false key不存在
+   */
+  template <typename K>
+  bool erase(const K& key) {
+    return map_.erase(key);
+  }
+
+  /// 使用预先计算的哈希值进行删除，hv必须为hash_of(key)的结果
+  template <typename K>
+  bool erase(const hash_value& hv, const K& key) {
+    return map_.erase(hv, key);
+  }
+
+  /// 容量收缩API接口
+  void shrink() { map_.shrink(); }
+
+  /// rehash API接口
+  bool rehash(size_type hp) { return map_.rehash(hp); }
+
+  /// reserve接口，预留能容纳n个key的内存空间
+  bool reserve(size_type n) { return map_.reserve(n); }
+
+  /// 清空集合，不释放内存
+  void clear() { map_.clear(); }
+
+  /// 清空集合，并释放内存
+  void clear_and_free() { map_.clear_and_free(); }
+
+  /// 锁住整个集合，构造locked_table
+  locked_table lock_table() { return locked_table(map_); }
+
+  /**
+   * @brief      获取统计指标
+   *
+   * @return     返回 json 格式的统计指标字符串，与map相同
+   */
+  std::string stat() { return map_.stat(); }
+
+ private:
+  /// 底层的map，value不占用存储
+  map_type map_;
+
+ public:
+  /**
+   * @brief 处于锁定状态的集合，支持按照存储顺序迭代所有key
+   */
+  class locked_table {
+   public:
+    using map_locked_table = typename map_type::locked_table;
+    using key_type = typename set::key_type;
+    using value_type = typename set::value_type;
+    using size_type = typename set::size_type;
+    using difference_type = typename set::difference_type;
+
+    /// 按照实际存储顺序迭代key的迭代器，key不能被修改
+    class const_iterator {
+     public:
+      using difference_type = typename locked_table::difference_type;
+      using value_type = typename locked_table::value_type;
+      using pointer = const value_type*;
+      using reference = const value_type&;
+      using iterator_category = std::bidirectional_iterator_tag;
+
+      const_iterator() = default;
+
+      bool operator==(const const_iterator& it) const {
+        using base = typename map_locked_table::const_iterator;
+        return static_cast<const base&>(it_) ==
+               static_cast<const base&>(it.it_);
+      }
+      bool operator!=(const const_iterator& it) const {
+        return !operator==(it);
+      }
+      /// 解引用操作符
+      reference operator*() const { return it_.key(); }
+      /// 箭头操作符
+      pointer operator->() const { return std::addressof(operator*()); }
+      /// 前置++操作符
+      const_iterator& operator++() {
+        ++it_;
+        return *this;
+      }
+      /// 后置++操作符
+      const_iterator operator++(int) {
+        const_iterator old(*this);
+        ++it_;
+        return old;
+      }
+      /// 前置--操作符
+      const_iterator& operator--() {
+        --it_;
+        return *this;
+      }
+      /// 后置--操作符
+      const_iterator operator--(int) {
+        const_iterator old(*this);
+        --it_;
+        return old;
+      }
+
+     private:
+      friend class locked_table;
+
+      explicit const_iterator(typename map_locked_table::iterator it)
+          : it_(it) {}
+
+      typename map_locked_table::iterator it_;
+    };
+
+    /// 集合中的key不能被修改，iterator与const_iterator相同
+    using iterator = const_iterator;
+
+    /// 禁止locked_table对象的拷贝
+    locked_table(const locked_table&) = delete;
+    locked_table& operator=(const locked_table&) = delete;
+
+    /// 移动构造函数
+    locked_table(locked_table&& lt) noexcept : locked_(std::move(lt.locked_)) {}
+
+    /// 移动赋值操作符
+    locked_table& operator=(locked_table&& lt) noexcept {
+      locked_ = std::move(lt.locked_);
+      return *this;
+    }
+
+    /// 解锁
+    void unlock() { locked_.unlock(); }
+
+    /// 返回指向第一个key的迭代器（按照存储顺序）
+    const_iterator begin() { return const_iterator(locked_.begin()); }
+
+    /// 返回指向最后一个key后面的迭代器（按照存储顺序）
+    const_iterator end() { return const_iterator(locked_.end()); }
+
+    /// 返回指向第一个key的迭代器（按照存储顺序）
+    const_iterator cbegin() { return begin(); }
+
+    /// 返回指向最后一个key后面的迭代器（按照存储顺序）
+    const_iterator cend() { return end(); }
+
+    /// 判断key是否存在，不需要再对bucket加锁
+    template <typename K>
+    bool contains(const K& key) const {
+      return locked_.count(key) != 0;
+    }
+
+    /**
+     * @brief 插入key，不需要再对bucket加锁；需要扩容时直接在当前线程中完成
+     *
+     * @return std::pair<const_iterator, bool> 指向key所在位置的迭代器，以及是否插入成功
+     */
+    template <typename K>
+    std::pair<const_iterator, bool> insert(K&& key) {
+      auto res = locked_.insert(std::forward<K>(key));
+      return std::make_pair(const_iterator(res.first), res.second);
+    }
+
+    /**
+     * @brief 删除key，不需要再对bucket加锁
+     * @return size_type 被删除的元素个数（0或1）
+     */
+    template <typename K>
+    size_type erase(const K& key) {
+      return locked_.erase(key);
+    }
+
+    /// 删除迭代器指向的key，返回指向下一个key的迭代器
+    const_iterator erase(const_iterator pos) {
+      return const_iterator(locked_.erase(pos.it_));
+    }
+
+   private:
+    explicit locked_table(map_type& m) : locked_(m.lock_table()) {}
+
+    /// 底层map的locked_table，持有所有的自旋锁
+    map_locked_table locked_;
+    friend class set;
+  };
+};
+
+}  // namespace rbhash
@@ -0,0 +1,554 @@
+// Copyright (c) 2020 The rbhash Authors. All rights reserved.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rbhash.hpp"
+
+namespace rbhash {
+
+/**
+ * @brief 分片哈希表：按照哈希值的高位把key路由到N个相互独立的map
+ *
+ * @details
+ * 每个分片（shard）都是一个完整的map，拥有自己的自旋锁集合，独立地扩容、收缩和清空；
+ *          map的linear_expand()会锁住整个map，分片之后一次扩容只会阻塞1/N的key空间。
+ *          分片使用哈希值的高位（先乘以黄金分割常数进行混合，避免std::hash对整数为恒等映射时
+ *          高位全为0），而map内部使用哈希值的低位作为索引，二者互不相关。
+ *
+ * @tparam Key 哈希表中存储的键类型
+ * @tparam Value 哈希表中存储的值类型
+ * @tparam Hash 哈希函数，默认使用std::hash<Key>
+ * @tparam KeyEqual 判断Key是否相等的相等函数，默认使用std::equal_to<Key>
+ * @tparam Allocator 自定义Allocator，默认使用std::allocator<std::pair<const
+ * Key, Value>>
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>,
+          typename KeyEqual = std::equal_to<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, Value>>>
+class sharded_map {
+ public:
+  /// 每个分片的类型
+  using shard_type = map<Key, Value, Hash, KeyEqual, Allocator>;
+  /// 和标准库类似，定义key_type，这里直接使用map中的定义
+  using key_type = typename shard_type::key_type;
+  /// 和标准库类似，定义mapped_type，这里直接使用map中的定义
+  using mapped_type = typename shard_type::mapped_type;
+  /// 和标准库类似，定义value_type，这里直接使用map中的定义
+  using value_type = typename shard_type::value_type;
+  /// 定义size_type，这里直接使用map中的定义
+  using size_type = typename shard_type::size_type;
+  /// 和标准库类似，这里直接使用map中的定义
+  using reference = typename shard_type::reference;
+  /// 和标准库类似，这里直接使用map中的定义
+  using const_reference = typename shard_type::const_reference;
+  /// 和标准库类似，这里直接使用map中的定义
+  using pointer = typename shard_type::pointer;
+  /// 和标准库类似，这里直接使用map中的定义
+  using const_pointer = typename shard_type::const_pointer;
+  /// 和标准库类似，定义迭代器差值类型
+  using difference_type = std::ptrdiff_t;
+  /// 定义hasher为模板参数Hash函数的别名
+  using hasher = Hash;
+  /// 定义key_equal为模板参数KeyEqual函数的别名
+  using key_equal = KeyEqual;
+  /// 预先计算的哈希值，与分片使用相同的定义
+  using hash_value = typename shard_type::hash_value;
+  /// 第一个参数为hash_value时，不匹配以key作为第一个参数的重载
+  template <typename K>
+  using disable_if_hash_value =
+      typename shard_type::template disable_if_hash_value<K>;
+
+  /// 前向声明locked_table类型，表示所有分片都处于锁定状态的哈希表
+  class locked_table;
+
+  /**
+   * @brief 构造sharded_map，初始状态为空
+   *
+   * @param num_shards 分片个数，向上取整为2的幂，默认与CPU核心数相关
+   * @param hp （hashpower）哈希表的初始总容量（容量大小为2^hashpower，均分给每个分片）
+   * @param hf 哈希函数
+   * @param eq_f 相等函数，用于判断key值是否相等
+   */
+  explicit sharded_map(size_type num_shards = default_num_shards(),
+                       size_type hp = HASHMAP_DEFAULT_HASHPOWER,
+                       const Hash& hf = Hash(),
+                       const KeyEqual& eq_f = KeyEqual(),
+                       const Allocator& alloc = Allocator())
+      : hash_fn_(hf), shard_bits_(0) {
+    while ((size_type(1) << shard_bits_) < num_shards) {
+      ++shard_bits_;
+    }
+    const size_type shard_hp = hp > shard_bits_ ? hp - shard_bits_ : 0;
+    shards_.reserve(size_type(1) << shard_bits_);
+    for (size_type i = 0; i < (size_type(1) << shard_bits_); ++i) {
+      shards_.emplace_back(new shard_type(shard_hp, hf, eq_f, alloc));
+    }
+  }
+
+  /**
+   * @brief sharded_map不支持拷贝构造和拷贝赋值
+   */
+  sharded_map(sharded_map const&) = delete;
+  sharded_map& operator=(sharded_map const&) = delete;
+
+  /// 默认的分片个数：CPU核心数向上取整为2的幂
+  static size_type default_num_shards() {
+    const size_type cores =
+        std::max(1U, std::thread::hardware_concurrency());
+    size_type n = 1;
+    while (n < cores) {
+      n <<= 1;
+    }
+    return n;
+  }
+
+  /// 获取哈希函数
+  hasher hash_function() const { return hash_fn_; }
+
+  /// 获取分片个数
+  size_type num_shards() const { return shards_.size(); }
+
+  /// 获取key所在分片的索引
+  template <typename K>
+  size_type shard_index(const K& key) const {
+    return shard_index(hash_of(key));
+  }
+
+  /// 根据预先计算的哈希值获取分片索引
+  size_type shard_index(const hash_value& hv) const {
+    if (shard_bits_ == 0) {
+      return 0;
+    }
+    const uint64_t mixed = static_cast<uint64_t>(hv.hash) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_type>(mixed >> (64 - shard_bits_));
+  }
+
+  /// 计算key的哈希值，结果可以传给接受哈希值的重载，也可以用于哈希函数相同的map
+  template <typename K>
+  hash_value hash_of(const K& key) const {
+    return shards_.front()->hash_of(key);
+  }
+
+  /// 获取第i个分片，可用于对单个分片进行收缩、清空等操作
+  shard_type& shard(size_type i) { return *shards_[i]; }
+  const shard_type& shard(size_type i) const { return *shards_[i]; }
+
+  /// 获取所有分片中bucket的总数
+  size_type bucket_count() const {
+    size_type n = 0;
+    for (auto& s : shards_) {
+      n += s->bucket_count();
+    }
+    return n;
+  }
+
+  /// 获取哈希表的容量
+  size_type capacity() const { return bucket_count(); }
+
+  /// 获取所有分片的元素总数
+  size_type size() const {
+    size_type n = 0;
+    for (auto& s : shards_) {
+      n += s->size();
+    }
+    return n;
+  }
+
+  /// 判断哈希表当前是否为空
+  bool empty() const { return size() == 0; }
+
+  /// 获取哈希表整体的负载情况
+  double load_factor() const {
+    return static_cast<double>(size()) / static_cast<double>(capacity());
+  }
+
+  /// 估算所有分片占用内存大小，字节数
+  size_type footprint() const {
+    size_type n = sizeof(*this) + shards_.size() * sizeof(shard_type);
+    for (auto& s : shards_) {
+      n += s->footprint();
+    }
+    return n;
+  }
+
+  /// 设置每个分片扩容时允许启动的额外线程数
+  void max_num_worker_threads(size_type extra_threads) {
+    for (auto& s : shards_) {
+      s->max_num_worker_threads(extra_threads);
+    }
+  }
+
+  /**
+   * @brief 设置每个分片允许使用的最大自旋锁数目
+   * @note 非线程安全，必须在哈希表被多个线程共享之前调用
+   */
+  void max_num_locks(size_type n) {
+    for (auto& s : shards_) {
+      s->max_num_locks(n);
+    }
+  }
+
+  /**
+   * @brief 设置每个分片对哈希函数结果的混合策略，分片路由同样使用混合后的哈希值
+   *
+   * @note 非线程安全，必须在哈希表被多个线程共享之前调用；哈希表非空时，
+   *       路由发生变化的元素会被迁移到新的分片
+   */
+  void mixer(hash_mixer m) {
+    if (m == mixer()) return;
+    for (auto& s : shards_) {
+      s->mixer(m);
+    }
+    std::vector<std::pair<key_type, mapped_type>> moved;
+    for (size_type i = 0; i < shards_.size(); ++i) {
+      auto locked = shards_[i]->lock_table();
+      for (auto it = locked.begin(); it != locked.end();) {
+        if (shard_index(it->first) != i) {
+          moved.emplace_back(it->first, std::move(it->second));
+          it = locked.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+    for (auto& p : moved) {
+      insert(std::move(p.first), std::move(p.second));
+    }
+  }
+
+  /// 获取分片当前使用的混合策略
+  hash_mixer mixer() const { return shards_.front()->mixer(); }
+
+  /// Key-Value插入操作的API接口，路由到key所在的分片
+  template <typename K, typename... Args,
+            typename = disable_if_hash_value<K>>
+  bool insert(K&& key, Args&&... val) {
+    const hash_value hv = hash_of(key);
+    return insert(hv, std::forward<K>(key), std::forward<Args>(val)...);
+  }
+
+  /// 使用预先计算的哈希值进行插入，路由到key所在的分片
+  template <typename K, typename... Args>
+  bool insert(const hash_value& hv, K&& key, Args&&... val) {
+    return shard_of(hv).insert(hv, std::forward<K>(key),
+                               std::forward<Args>(val)...);
+  }
+
+  /// 原地构造插入的API接口，路由到key所在的分片
+  template <typename K, typename... Args>
+  bool try_emplace(K&& key, Args&&... args) {
+    return shard_of(key).try_emplace(std::forward<K>(key),
+                                     std::forward<Args>(args)...);
+  }
+
+  /// 查找key，不存在时使用factory()构造value并插入，路由到key所在的分片
+  template <typename K, typename F>
+  typename shard_type::locked_ptr get_or_insert_with(K&& key, F factory) {
+    return shard_of(key).get_or_insert_with(std::forward<K>(key), factory);
+  }
+
+  /// 查找key并返回访问句柄，路由到key所在的分片
+  template <typename K>
+  typename shard_type::locked_ptr find_ptr(const K& key) {
+    return shard_of(key).find_ptr(key);
+  }
+
+  /// 哈希表插入或者修改API接口，路由到key所在的分片
+  template <typename K, typename V>
+  bool insert_or_assign(K&& key, V&& val) {
+    return shard_of(key).insert_or_assign(std::forward<K>(key),
+                                          std::forward<V>(val));
+  }
+
+  /// Key-Value查找的API接口，路由到key所在的分片
+  template <typename K, typename = disable_if_hash_value<K>>
+  bool find(const K& key, mapped_type& val) const {
+    return shard_of(key).find(key, val);
+  }
+
+  /// 使用预先计算的哈希值进行查找，路由到key所在的分片
+  template <typename K>
+  bool find(const hash_value& hv, const K& key, mapped_type& val) const {
+    return shard_of(hv).find(hv, key, val);
+  }
+
+  /**
+   * @brief Key-Value查找的API接口，路由到key所在的分片
+   * @note 如果key不存在表中，则会抛std::out_of_range异常
+   */
+  template <typename K>
+  mapped_type find(const K& key) {
+    return shard_of(key).find(key);
+  }
+
+  /// 使用预先计算的哈希值进行查找，key不存在时抛std::out_of_range异常
+  template <typename K>
+  mapped_type find(const hash_value& hv, const K& key) {
+    return shard_of(hv).find(hv, key);
+  }
+
+  /// Key-Value更新的API接口，路由到key所在的分片
+  template <typename K, typename V>
+  bool update(const K& key, V&& val) {
+    return shard_of(key).update(key, std::forward<V>(val));
+  }
+
+  /// 更新/插入API接口，路由到key所在的分片
+  template <typename K, typename F, typename... Args,
+            typename = disable_if_hash_value<K>>
+  bool upsert(K&& key, F fn, Args&&... val) {
+    const hash_value hv = hash_of(key);
+    return upsert(hv, std::forward<K>(key), fn, std::forward<Args>(val)...);
+  }
+
+  /// 使用预先计算的哈希值进行更新或插入，路由到key所在的分片
+  template <typename K, typename F, typename... Args>
+  bool upsert(const hash_value& hv, K&& key, F fn, Args&&... val) {
+    return shard_of(hv).upsert(hv, std::forward<K>(key), fn,
+                               std::forward<Args>(val)...);
+  }
+
+  /// 删除Key的API接口，路由到key所在的分片
+  template <typename K>
+  bool erase(const K& key) {
+    return shard_of(key).erase(key);
+  }
+
+  /// 使用预先计算的哈希值进行删除，路由到key所在的分片
+  template <typename K>
+  bool erase(const hash_value& hv, const K& key) {
+    return shard_of(hv).erase(hv, key);
+  }
+
+  /// 查找API的辅助函数，路由到key所在的分片
+  template <typename K, typename F>
+  bool find_fn(const K& key, F fn) const {
+    return shard_of(key).find_fn(key, fn);
+  }
+
+  /// 更新API的辅助函数，路由到key所在的分片
+  template <typename K, typename F>
+  bool update_fn(const K& key, F fn) const {
+    return shard_of(key).update_fn(key, fn);
+  }
+
+  /// 使用预先计算的哈希值的update_fn()，路由到key所在的分片
+  template <typename K, typename F>
+  bool update_fn(const hash_value& hv, const K& key, F fn) const {
+    return shard_of(hv).update_fn(hv, key, fn);
+  }
+
+  /// 依次对每个分片执行容量收缩，每次只阻塞一个分片
+  void shrink() {
+    for (auto& s : shards_) {
+      s->shrink();
+    }
+  }
+
+  /// 哈希表reserve接口，把n均分给每个分片
+  void reserve(size_type n) {
+    const size_type per_shard = (n + shards_.size() - 1) / shards_.size();
+    for (auto& s : shards_) {
+      s->reserve(per_shard);
+    }
+  }
+
+  /// 依次清空每个分片，不释放内存
+  void clear() {
+    for (auto& s : shards_) {
+      s->clear();
+    }
+  }
+
+  /// 依次清空每个分片，并释放内存
+  void clear_and_free() {
+    for (auto& s : shards_) {
+      s->clear_and_free();
+    }
+  }
+
+  /// 按照分片顺序锁住所有分片，构造locked_table
+  locked_table lock_table() { return locked_table(*this); }
+
+  /**
+   * @brief      获取统计指标
+   *
+   * @return     返回 json 格式的统计指标字符串，包含汇总值以及每个分片的指标
+   */
+  std::string stat() {
+    std::string shards;
+    for (auto& s : shards_) {
+      shards += (shards.empty() ? "" : ",") + s->stat();
+    }
+    return "{\"num_shards\":" + std::to_string(num_shards()) +
+           ",\"size\":" + std::to_string(size()) +
+           ",\"capacity\":" + std::to_string(capacity()) +
+           ",\"load_factor\":" + std::to_string(load_factor()) +
+           ",\"footprint\":" + std::to_string(footprint()) +
+           ",\"shards\":[" + shards + "]}";
+  }
+
+ private:
+  template <typename K>
+  shard_type& shard_of(const K& key) const {
+    return *shards_[shard_index(key)];
+  }
+
+  /// 哈希函数，用于选择分片
+  hasher hash_fn_;
+  /// 分片个数为2^shard_bits_
+  size_type shard_bits_;
+  /// 所有分片
+  std::vector<std::unique_ptr<shard_type>> shards_;
+
+ public:
+  /**
+   * @brief 所有分片都处于锁定状态的哈希表，按照分片顺序依次迭代每个分片中的元素
+   */
+  class locked_table {
+   public:
+    using shard_locked_table = typename shard_type::locked_table;
+    using size_type = typename sharded_map::size_type;
+    using difference_type = typename sharded_map::difference_type;
+    using value_type = typename sharded_map::value_type;
+
+    /**
+     * @brief 依次遍历每个分片的迭代器
+     *
+     * @tparam ShardIt 分片locked_table的迭代器类型（iterator或const_iterator）
+     * @tparam Ref 解引用得到的引用类型
+     * @tparam Ptr 箭头操作符得到的指针类型
+     */
+    template <typename ShardIt, typename Ref, typename Ptr>
+    class basic_iterator {
+     public:
+      using difference_type = typename locked_table::difference_type;
+      using value_type = typename locked_table::value_type;
+      using pointer = Ptr;
+      using reference = Ref;
+      using iterator_category = std::forward_iterator_tag;
+
+      basic_iterator() = default;
+
+      bool operator==(const basic_iterator& it) const {
+        return shards_ == it.shards_ && shard_ == it.shard_ &&
+               same(it_, it.it_);
+      }
+      bool operator!=(const basic_iterator& it) const {
+        return !operator==(it);
+      }
+      /// 解引用操作符
+      reference operator*() const { return *it_; }
+      /// 箭头操作符
+      pointer operator->() const { return std::addressof(operator*()); }
+      /// 前置++操作符，当前分片遍历结束后进入下一个分片
+      basic_iterator& operator++() {
+        ++it_;
+        skip_exhausted();
+        return *this;
+      }
+      /// 后置++操作符
+      basic_iterator operator++(int) {
+        basic_iterator old(*this);
+        ++(*this);
+        return old;
+      }
+
+     private:
+      friend class locked_table;
+
+      basic_iterator(std::vector<shard_locked_table>& shards, size_type shard,
+                     ShardIt it)
+          : shards_(&shards), shard_(shard), it_(it) {
+        skip_exhausted();
+      }
+
+      static bool same(const ShardIt& a, const ShardIt& b) {
+        using base = typename shard_locked_table::const_iterator;
+        return static_cast<const base&>(a) == static_cast<const base&>(b);
+      }
+
+      void skip_exhausted() {
+        while (shard_ + 1 < shards_->size() &&
+               same(it_, (*shards_)[shard_].end())) {
+          ++shard_;
+          it_ = (*shards_)[shard_].begin();
+        }
+      }
+
+      std::vector<shard_locked_table>* shards_ = nullptr;
+      size_type shard_ = 0;
+      mutable ShardIt it_;
+    };
+
+    /// 按照分片顺序进行迭代的迭代器
+    using iterator =
+        basic_iterator<typename shard_locked_table::iterator,
+                       typename sharded_map::reference,
+                       typename sharded_map::pointer>;
+    /// 按照分片顺序进行迭代的const迭代器
+    using const_iterator =
+        basic_iterator<typename shard_locked_table::const_iterator,
+                       typename sharded_map::const_reference,
+                       typename sharded_map::const_pointer>;
+
+    /// 禁止locked_table对象的拷贝
+    locked_table(const locked_table&) = delete;
+    locked_table& operator=(const locked_table&) = delete;
+
+    /// 移动构造函数
+    locked_table(locked_table&& lt) noexcept : shards_(std::move(lt.shards_)) {}
+
+    /// 移动赋值操作符
+    locked_table& operator=(locked_table&& lt) noexcept {
+      unlock();
+      shards_ = std::move(lt.shards_);
+      return *this;
+    }
+
+    /// 按照加锁的逆序解锁所有分片
+    void unlock() {
+      while (!shards_.empty()) {
+        shards_.pop_back();
+      }
+    }
+
+    /// 返回指向第一个元素的迭代器
+    iterator begin() { return iterator(shards_, 0, shards_[0].begin()); }
+
+    /// 返回指向最后一个元素后面的迭代器
+    iterator end() {
+      return iterator(shards_, shards_.size() - 1, shards_.back().end());
+    }
+
+    /// 返回指向第一个元素的const迭代器
+    const_iterator cbegin() {
+      return const_iterator(shards_, 0, shards_[0].cbegin());
+    }
+
+    /// 返回指向最后一个元素后面的const迭代器
+    const_iterator cend() {
+      return const_iterator(shards_, shards_.size() - 1,
+                            shards_.back().cend());
+    }
+
+   private:
+    explicit locked_table(sharded_map& m) {
+      shards_.reserve(m.shards_.size());
+      for (auto& s : m.shards_) {
+        shards_.push_back(s->lock_table());
+      }
+    }
+
+    /// 每个分片的locked_table，按照分片顺序加锁
+    std::vector<shard_locked_table> shards_;
+    friend class sharded_map;
+  };
+};
+
+}  // namespace rbhash
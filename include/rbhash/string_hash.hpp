@@ -0,0 +1,90 @@
+// Copyright (c) 2020 The rbhash Authors. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+namespace rbhash {
+
+/**
+ * @brief 对一段字节序列计算64位哈希值，每次处理8个字节
+ *
+ * @note 最后会对结果做一次完整的混合（murmur3的fmix64），保证低位同样分布均匀，
+ *       map使用哈希值的低位作为bucket索引
+ */
+inline uint64_t hash_bytes(const char* data, size_t len) {
+  auto fmix64 = [](uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  };
+  const uint64_t m = 0x9E3779B97F4A7C15ULL;
+  uint64_t h = len * m;
+  for (; len >= 8; data += 8, len -= 8) {
+    uint64_t w;
+    memcpy(&w, data, 8);
+    h = (h ^ fmix64(w)) * m;
+  }
+  if (len > 0) {
+    uint64_t w = 0;
+    memcpy(&w, data, len);
+    h = (h ^ fmix64(w)) * m;
+  }
+  return fmix64(h);
+}
+
+/**
+ * @brief 支持异构查找（is_transparent）的字符串哈希函数
+ *
+ * @details
+ * std::string、const char*以及（C++17）std::string_view对相同的字符序列得到相同的
+ *          哈希值；与string_equal一起作为map的Hash和KeyEqual时，使用const char*或
+ *          std::string_view查找map<std::string, V>不会构造临时的std::string
+ */
+struct string_hash {
+  using is_transparent = void;
+
+  size_t operator()(const std::string& s) const {
+    return static_cast<size_t>(hash_bytes(s.data(), s.size()));
+  }
+  size_t operator()(const char* s) const {
+    return static_cast<size_t>(hash_bytes(s, strlen(s)));
+  }
+#if __cplusplus >= 201703L
+  size_t operator()(std::string_view s) const {
+    return static_cast<size_t>(hash_bytes(s.data(), s.size()));
+  }
+#endif
+};
+
+/**
+ * @brief 支持异构查找（is_transparent）的字符串相等函数，配合string_hash使用
+ */
+struct string_equal {
+  using is_transparent = void;
+
+  bool operator()(const std::string& a, const std::string& b) const {
+    return a == b;
+  }
+  bool operator()(const std::string& a, const char* b) const { return a == b; }
+  bool operator()(const char* a, const std::string& b) const { return b == a; }
+#if __cplusplus >= 201703L
+  bool operator()(const std::string& a, std::string_view b) const {
+    return a == b;
+  }
+  bool operator()(std::string_view a, const std::string& b) const {
+    return a == b;
+  }
+#endif
+};
+
+}  // namespace rbhash
@@ -0,0 +1,746 @@
+// Copyright (c) 2020 The rbhash Authors. All rights reserved.
+
+#pragma once
+
+#include <stdexcept>
+
+#include "rbhash.hpp"
+#include "string_hash.hpp"
+
+namespace rbhash {
+
+/**
+ * @brief
+ * 字符串key专用的并发线程安全哈希表：短key直接保存在slot中，长key保存在哈希表私有的
+ * 只追加（append-only）字节区（arena）中
+ *
+ * @details
+ * map<std::string, V>的每个bucket中都有一个32字节的std::string，超过15字节的key还各自
+ *          拥有一次堆分配，查找时需要两次相互依赖的访存，扩容时也要逐个移动字符串。
+ *          string_map的slot只有哈希值、长度以及InlineSize字节的key区：长度不超过InlineSize
+ *          的key直接保存在key区中，更长的key拷贝到arena中，key区只保存其地址。arena按块
+ *          申请，块一旦申请就不会移动，扩容时只拷贝slot，不移动任何字符串。
+ *          查找时先比较缓存的哈希值和长度，只有二者都相同时才比较字符串本身。
+ *          加锁方式与int_map相同（按照slot交错分配的固定数目的自旋锁）
+ *
+ * @note 删除长key时arena中的字节不会被立即回收，扩容时如果arena中的无效字节超过一半，
+ *       则把所有有效的长key压缩到新的arena中；clear()释放整个arena
+ * @note 墓碑不会被复用，只在扩容时被清除；墓碑超过容量的1/4时按照原容量重建
+ * @note 哈希函数固定为hash_bytes()，与string_hash相同
+ *
+ * @tparam Value 哈希表中存储的值类型
+ * @tparam Allocator 自定义Allocator，默认使用std::allocator<std::pair<const
+ * std::string, Value>>
+ * @tparam InlineSize slot中key区的字节数，长度不超过它的key不使用arena
+ */
+template <typename Value,
+          typename Allocator =
+              std::allocator<std::pair<const std::string, Value>>,
+          std::size_t InlineSize = 20>
+class string_map {
+  static_assert(InlineSize >= sizeof(const char*),
+                "string_map requires inline key area to hold a pointer");
+
+ private:
+  using traits_ = typename std::allocator_traits<
+      Allocator>::template rebind_traits<Value>;
+
+ public:
+  /// 和标准库类似，定义key_type为std::string的别名
+  using key_type = std::string;
+  /// 和标准库类似，定义mapped_type为Value的别名
+  using mapped_type = Value;
+  /// 和标准库类似，定义size_type类型
+  using size_type = std::size_t;
+  /// 和标准库类似，定义allocator_type类型
+  using allocator_type = typename traits_::allocator_type;
+
+  /**
+   * @brief 构造给定容量的string_map，初始状态为空
+   *
+   * @param hp （hashpower）哈希表的初始容量（容量大小为2^hashpower）
+   */
+  explicit string_map(size_type hp = HASHMAP_DEFAULT_HASHPOWER,
+                      const Allocator& alloc = Allocator())
+      : allocator_(alloc),
+        slot_allocator_(allocator_),
+        arena_(alloc),
+        hashpower_(hp),
+        slots_(create_slots(hp)),
+        tombstones_(0),
+        version_(0),
+        locks_(default_num_locks()) {}
+
+  /**
+   * @brief string_map不支持拷贝和移动
+   */
+  string_map(string_map const&) = delete;
+  string_map& operator=(string_map const&) = delete;
+
+  /**
+   * @brief 析构函数，释放所有键值对、slot数组以及arena
+   */
+  ~string_map() { destroy_slots(slots_, hashpower()); }
+
+  /// 直接保存在slot中的key的最大长度
+  static constexpr size_type inline_size() { return InlineSize; }
+
+  /// 获取hashpower
+  size_type hashpower() const {
+    return hashpower_.load(std::memory_order_acquire);
+  }
+
+  /// 获取slot的数量
+  size_type bucket_count() const { return hashsize(hashpower()); }
+
+  /// 获取哈希表的容量
+  size_type capacity() const { return bucket_count(); }
+
+  /// 获取哈希表的当前大小（并发修改时为近似值）
+  size_type size() const {
+    counter_type s = 0;
+    for (const spinlock_t& lock : locks_) {
+      s += lock.elem_counter();
+    }
+    assert(s >= 0);
+    return static_cast<size_type>(s);
+  }
+
+  /// 判断哈希表当前是否为空
+  bool empty() const { return size() == 0; }
+
+  /// 获取哈希表的负载情况
+  double load_factor() const {
+    return static_cast<double>(size()) / static_cast<double>(capacity());
+  }
+
+  /// 返回哈希表占用的内存大小（包括arena），字节数
+  size_type footprint() const {
+    return sizeof(slot) * capacity() + sizeof(spinlock_t) * locks_.size() +
+           arena_.reserved();
+  }
+
+  /// 返回arena中已经使用的字节数（包括已删除的长key）
+  size_type arena_bytes() const { return arena_.used(); }
+
+  /**
+   * @brief Key-Value插入操作的API接口
+   *
+   * @tparam K key的类型：std::string、const char*或者（C++17）std::string_view
+   * @param key 待插入的key
+   * @param val 用于构造value的参数
+   * @return true 插入哈希表成功
+   * @return false key已经存在，插入失败
+   */
+  template <typename K, typename... Args>
+  bool insert(const K& key, Args&&... val) {
+    return upsert(key, [](mapped_type&) {}, std::forward<Args>(val)...);
+  }
+
+  /**
+   * @brief key不存在时插入，存在时赋值
+   *
+   * @return true 插入了新的键值对
+   * @return false key已经存在，value被赋值为val
+   */
+  template <typename K, typename V>
+  bool insert_or_assign(const K& key, V&& val) {
+    return upsert(key, [&val](mapped_type& m) { m = std::forward<V>(val); },
+                  std::forward<V>(val));
+  }
+
+  /**
+   * @brief key已经存在时对其value执行fn，否则使用val构造value并插入
+   *
+   * @return true 插入了新的键值对
+   * @return false key已经存在，执行了fn
+   * @throw std::length_error key的长度超过了slot能够表示的范围
+   */
+  template <typename K, typename F, typename... Args>
+  bool upsert(const K& key, F fn, Args&&... val) {
+    const key_view k = view_of(key);
+    if (k.len >= kDeletedLen) {
+      throw std::length_error("string_map key too long");
+    }
+    const uint64_t hv = hash_bytes(k.data, k.len);
+    size_type ind = 0;
+    bool duplicated = false;
+    LockManager lock = insert_slot(k, hv, ind, duplicated);
+    slot& s = slots_[ind];
+    if (duplicated) {
+      fn(s.mapped());
+      return false;
+    }
+    traits_::construct(allocator_, &s.mapped(), std::forward<Args>(val)...);
+    if (k.len <= InlineSize) {
+      memcpy(s.key, k.data, k.len);
+    } else {
+      const char* p = arena_.store(k.data, k.len);
+      memcpy(s.key, &p, sizeof(p));
+    }
+    s.hash = hv;
+    s.len = static_cast<uint32_t>(k.len);
+    ++lock->elem_counter();
+    return true;
+  }
+
+  /**
+   * @brief Key-Value查找的API接口
+   *
+   * @param key 待查找的key
+   * @param val 如果key在哈希表中，键key所关联的value值
+   * @return true key存在于哈希表中
+   * @return false key不在哈希表中
+   */
+  template <typename K>
+  bool find(const K& key, mapped_type& val) const {
+    return find_fn(key, [&val](const mapped_type& v) { val = v; });
+  }
+
+  /**
+   * @brief Key-Value查找的API接口
+   *
+   * @return mapped_type 在表中key所关联的value值
+   * @note 如果key不存在表中，则会抛std::out_of_range异常
+   */
+  template <typename K>
+  mapped_type find(const K& key) const {
+    size_type ind = 0;
+    LockManager lock = find_slot(view_of(key), ind);
+    if (!lock) {
+      throw std::out_of_range("key not found");
+    }
+    return slots_[ind].mapped();
+  }
+
+  /// 判断key是否存在于哈希表中
+  template <typename K>
+  bool contains(const K& key) const {
+    size_type ind = 0;
+    return static_cast<bool>(find_slot(view_of(key), ind));
+  }
+
+  /**
+   * @brief 查找key，存在时在持有自旋锁的情况下对value执行只读操作fn
+   *
+   * @return true key在哈希表中，执行了fn
+   * @return false key不在哈希表中
+   */
+  template <typename K, typename F>
+  bool find_fn(const K& key, F fn) const {
+    size_type ind = 0;
+    LockManager lock = find_slot(view_of(key), ind);
+    if (!lock) {
+      return false;
+    }
+    fn(static_cast<const mapped_type&>(slots_[ind].mapped()));
+    return true;
+  }
+
+  /**
+   * @brief 查找key，存在时在持有自旋锁的情况下对value执行fn
+   *
+   * @return true key在哈希表中，执行了fn
+   * @return false key不在哈希表中
+   */
+  template <typename K, typename F>
+  bool update_fn(const K& key, F fn) {
+    size_type ind = 0;
+    LockManager lock = find_slot(view_of(key), ind);
+    if (!lock) {
+      return false;
+    }
+    fn(slots_[ind].mapped());
+    return true;
+  }
+
+  /// key存在时将其value更新为val
+  template <typename K, typename V>
+  bool update(const K& key, V&& val) {
+    return update_fn(key,
+                     [&val](mapped_type& m) { m = std::forward<V>(val); });
+  }
+
+  /**
+   * @brief 删除key，slot变为墓碑
+   *
+   * @return true 删除成功
+   * @return false key不在哈希表中
+   */
+  template <typename K>
+  bool erase(const K& key) {
+    size_type ind = 0;
+    LockManager lock = find_slot(view_of(key), ind);
+    if (!lock) {
+      return false;
+    }
+    slot& s = slots_[ind];
+    traits_::destroy(allocator_, &s.mapped());
+    if (s.len > InlineSize) {
+      arena_.release(s.len);
+    }
+    s.len = kDeletedLen;
+    --lock->elem_counter();
+    tombstones_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief 锁住整个哈希表，对每个键值对执行fn
+   *
+   * @tparam F 形如void(const char* key, size_type len, mapped_type&)的函数类型
+   * @note fn中不能再调用本哈希表的接口，否则会死锁
+   */
+  template <typename F>
+  void for_each(F fn) {
+    auto all_locks_manager = lock_all();
+    for (size_type i = 0; i < capacity(); ++i) {
+      slot& s = slots_[i];
+      if (s.live()) {
+        fn(s.data(), static_cast<size_type>(s.len), s.mapped());
+      }
+    }
+  }
+
+  /// 哈希表reserve接口，扩容直到可以容纳n个key-value对，不会缩容
+  void reserve(size_type n) {
+    auto all_locks_manager = lock_all();
+    size_type hp = hashpower();
+    while (hashsize(hp) < n) {
+      ++hp;
+    }
+    if (hp != hashpower()) {
+      rebuild(hp);
+    }
+  }
+
+  /// 清空哈希表中的所有元素，不释放slot数组，但释放arena
+  void clear() {
+    auto all_locks_manager = lock_all();
+    const size_type n = capacity();
+    for (size_type i = 0; i < n; ++i) {
+      slot& s = slots_[i];
+      if (s.live()) {
+        traits_::destroy(allocator_, &s.mapped());
+      }
+      s.len = kEmptyLen;
+    }
+    for (spinlock_t& lock : locks_) {
+      lock.elem_counter() = 0;
+    }
+    tombstones_.store(0, std::memory_order_relaxed);
+    arena_.reset();
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+ private:
+  /// 空slot的长度值
+  static constexpr uint32_t kEmptyLen = 0xFFFFFFFFU;
+  /// 墓碑的长度值
+  static constexpr uint32_t kDeletedLen = 0xFFFFFFFEU;
+
+  template <typename U>
+  using rebind_alloc =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<U>;
+
+  /// 待查找或插入的key，不拥有字符串
+  struct key_view {
+    const char* data;
+    size_type len;
+  };
+
+  static key_view view_of(const std::string& s) {
+    return key_view{s.data(), s.size()};
+  }
+  static key_view view_of(const char* s) { return key_view{s, strlen(s)}; }
+#if __cplusplus >= 201703L
+  static key_view view_of(std::string_view s) {
+    return key_view{s.data(), s.size()};
+  }
+#endif
+
+  /// 保存一个键值对的slot，len的取值同时表示slot的状态
+  struct slot {
+    /// key的哈希值
+    uint64_t hash;
+    /// 短key的内容，或者长key在arena中的地址
+    char key[InlineSize];
+    /// key的长度，或者kEmptyLen/kDeletedLen
+    uint32_t len;
+    typename std::aligned_storage<sizeof(mapped_type),
+                                  alignof(mapped_type)>::type storage;
+
+    bool live() const { return len < kDeletedLen; }
+
+    /// key的内容，长key指向arena
+    const char* data() const {
+      if (len <= InlineSize) {
+        return key;
+      }
+      const char* p;
+      memcpy(&p, key, sizeof(p));
+      return p;
+    }
+
+    bool matches(const key_view& k, uint64_t hv) const {
+      return hash == hv && len == k.len &&
+             memcmp(data(), k.data, k.len) == 0;
+    }
+
+    mapped_type& mapped() {
+      return *static_cast<mapped_type*>(static_cast<void*>(&storage));
+    }
+  };
+
+  /**
+   * @brief 只追加的字节区，长key按块保存，块一旦申请就不会移动
+   *
+   * @note store()可能被持有不同自旋锁的线程同时调用，使用独立的自旋锁保护
+   */
+  class key_arena {
+   public:
+    template <typename A>
+    explicit key_arena(const A& alloc)
+        : allocator_(alloc),
+          block_(nullptr),
+          pos_(kBlockSize),
+          used_(0),
+          reserved_(0),
+          released_(0) {}
+
+    key_arena(const key_arena&) = delete;
+    key_arena& operator=(const key_arena&) = delete;
+
+    ~key_arena() { reset(); }
+
+    /// 拷贝一个长key，返回它在arena中的地址
+    const char* store(const char* data, size_type len) {
+      std::lock_guard<spinlock_t> guard(lock_);
+      used_.fetch_add(len, std::memory_order_relaxed);
+      char* p = nullptr;
+      if (len > kBlockSize / 4) {
+        // 较长的key单独占用一块，避免浪费当前块的剩余空间
+        p = allocate(len);
+      } else {
+        if (pos_ + len > kBlockSize) {
+          block_ = allocate(kBlockSize);
+          pos_ = 0;
+        }
+        p = block_ + pos_;
+        pos_ += len;
+      }
+      memcpy(p, data, len);
+      return p;
+    }
+
+    /// 记录一个被删除的长key
+    void release(size_type len) {
+      std::lock_guard<spinlock_t> guard(lock_);
+      released_ += len;
+    }
+
+    /// 无效字节是否超过了一半
+    bool fragmented() const {
+      return released_ * 2 > used_.load(std::memory_order_relaxed);
+    }
+
+    /// 已经使用的字节数
+    size_type used() const { return used_.load(std::memory_order_relaxed); }
+
+    /// 申请的字节数
+    size_type reserved() const {
+      return reserved_.load(std::memory_order_relaxed);
+    }
+
+    /// 释放所有块
+    void reset() noexcept {
+      for (const auto& b : blocks_) {
+        allocator_.deallocate(b.first, b.second);
+      }
+      blocks_.clear();
+      block_ = nullptr;
+      pos_ = kBlockSize;
+      used_.store(0, std::memory_order_relaxed);
+      reserved_.store(0, std::memory_order_relaxed);
+      released_ = 0;
+    }
+
+    /// 与另一个arena交换内容
+    void swap(key_arena& other) noexcept {
+      blocks_.swap(other.blocks_);
+      std::swap(block_, other.block_);
+      std::swap(pos_, other.pos_);
+      std::swap(released_, other.released_);
+      used_.store(other.used_.exchange(used_.load(std::memory_order_relaxed),
+                                       std::memory_order_relaxed),
+                  std::memory_order_relaxed);
+      reserved_.store(
+          other.reserved_.exchange(reserved_.load(std::memory_order_relaxed),
+                                   std::memory_order_relaxed),
+          std::memory_order_relaxed);
+    }
+
+   private:
+    /// 每块的字节数
+    static constexpr size_type kBlockSize = 64 * 1024;
+
+    char* allocate(size_type n) {
+      char* p = allocator_.allocate(n);
+      blocks_.emplace_back(p, n);
+      reserved_.fetch_add(n, std::memory_order_relaxed);
+      return p;
+    }
+
+    rebind_alloc<char> allocator_;
+    /// 所有申请的块以及各自的字节数
+    std::vector<std::pair<char*, size_type>> blocks_;
+    /// 当前用于追加的块
+    char* block_;
+    /// 当前块中已经使用的字节数
+    size_type pos_;
+    /// 已经保存的字节数，footprint()等接口不加锁读取
+    std::atomic<size_type> used_;
+    /// 申请的字节数
+    std::atomic<size_type> reserved_;
+    /// 被删除的长key的字节数
+    size_type released_;
+    spinlock_t lock_;
+  };
+
+  /// 自旋锁集合类型，自旋锁数目固定，不随扩容变化
+  using locks_t = std::vector<spinlock_t, rebind_alloc<spinlock_t>>;
+
+  struct LockDeleter {
+    void operator()(spinlock_t* l) const { l->unlock(); }
+  };
+
+  /// spinlock_t的智能指针定义
+  using LockManager = std::unique_ptr<spinlock_t, LockDeleter>;
+
+  struct AllUnlocker {
+    void operator()(string_map* m) const {
+      for (spinlock_t& lock : m->locks_) {
+        lock.unlock();
+      }
+    }
+  };
+
+  /// 持有所有自旋锁的智能指针
+  using AllLocksManager = std::unique_ptr<string_map, AllUnlocker>;
+
+  static inline size_type hashsize(const size_type hp) {
+    return size_type(1) << hp;
+  }
+
+  static inline size_type hashmask(const size_type hp) {
+    return hashsize(hp) - 1;
+  }
+
+  static inline size_type index_hash(const size_type hp, const size_type hv) {
+    return hv & hashmask(hp);
+  }
+
+  /// 自旋锁数目与map的默认值相同（2的幂）
+  static size_type default_num_locks() {
+    const size_type cores =
+        std::max(1U, std::thread::hardware_concurrency());
+    size_type n = 1;
+    while (n < cores * HASHMAP_LOCKS_PER_CORE && n < (1UL << 16)) {
+      n <<= 1;
+    }
+    return n;
+  }
+
+  spinlock_t& lock_of(const size_type ind) const {
+    return locks_[ind & (locks_.size() - 1)];
+  }
+
+  slot* create_slots(size_type hp) {
+    slot* slots = slot_allocator_.allocate(hashsize(hp));
+    for (size_type i = 0; i < hashsize(hp); ++i) {
+      std::allocator_traits<rebind_alloc<slot>>::construct(slot_allocator_,
+                                                            &slots[i]);
+      slots[i].len = kEmptyLen;
+    }
+    return slots;
+  }
+
+  void destroy_slots(slot* slots, size_type hp) noexcept {
+    for (size_type i = 0; i < hashsize(hp); ++i) {
+      slot& s = slots[i];
+      if (s.live()) {
+        traits_::destroy(allocator_, &s.mapped());
+      }
+      std::allocator_traits<rebind_alloc<slot>>::destroy(slot_allocator_, &s);
+    }
+    slot_allocator_.deallocate(slots, hashsize(hp));
+  }
+
+  /**
+   * @brief 对ind指向的slot加锁；加锁之后发现slot数组被重建或清空过（version_发生了
+   *        变化），则按照新的hashpower重新计算key的home slot并重试
+   *
+   * @note 墓碑过多时按照原容量重建，hashpower不变但元素的位置可能前移，因此不能
+   *       只比较hashpower
+   */
+  LockManager lock_slot(uint64_t& version, size_type& hp, size_type& ind,
+                        size_type& probes, uint64_t hv) const {
+    while (true) {
+      spinlock_t& lock = lock_of(ind);
+      lock.lock();
+      if (version_.load(std::memory_order_relaxed) == version) {
+        return LockManager(&lock);
+      }
+      lock.unlock();
+      version = version_.load(std::memory_order_acquire);
+      hp = hashpower();
+      ind = index_hash(hp, hv);
+      probes = 0;
+    }
+  }
+
+  /**
+   * @brief 查找key所在的slot
+   *
+   * @return LockManager key存在时持有其所在slot的自旋锁，索引通过ind返回；
+   *         key不存在时为空
+   */
+  LockManager find_slot(const key_view& k, size_type& ind) const {
+    const uint64_t hv = hash_bytes(k.data, k.len);
+    uint64_t version = version_.load(std::memory_order_acquire);
+    size_type hp = hashpower(), probes = 0;
+    ind = index_hash(hp, hv);
+    while (true) {
+      LockManager lock = lock_slot(version, hp, ind, probes, hv);
+      const slot& s = slots_[ind];
+      if (s.len == kEmptyLen || ++probes > hashsize(hp)) {
+        return nullptr;
+      } else if (s.live() && s.matches(k, hv)) {
+        return lock;
+      }
+      ind = index_hash(hp, ind + 1);
+    }
+  }
+
+  /**
+   * @brief 查找key所在的slot或者可以插入key的空slot，探测次数超过hashpower时扩容
+   *
+   * @return LockManager 持有slot的自旋锁，索引通过ind返回；key已经存在时duplicated为true
+   */
+  LockManager insert_slot(const key_view& k, uint64_t hv, size_type& ind,
+                          bool& duplicated) {
+    uint64_t version = version_.load(std::memory_order_acquire);
+    size_type hp = hashpower(), probes = 0;
+    ind = index_hash(hp, hv);
+    while (true) {
+      LockManager lock = lock_slot(version, hp, ind, probes, hv);
+      const slot& s = slots_[ind];
+      if (s.len == kEmptyLen) {
+        duplicated = false;
+        return lock;
+      } else if (s.live() && s.matches(k, hv)) {
+        duplicated = true;
+        return lock;
+      }
+      ind = index_hash(hp, ind + 1);
+      if (++probes >= hp) {
+        lock.reset();
+        grow(version);
+        version = version_.load(std::memory_order_acquire);
+        hp = hashpower();
+        ind = index_hash(hp, hv);
+        probes = 0;
+      }
+    }
+  }
+
+  /// 按照固定顺序锁住所有自旋锁，获取哈希表的唯一访问权限
+  AllLocksManager lock_all() {
+    for (spinlock_t& lock : locks_) {
+      lock.lock();
+    }
+    return AllLocksManager(this);
+  }
+
+  /**
+   * @brief 扩容为原来的2倍；墓碑超过容量的1/4或者多于有效元素时只按照原容量重建。
+   *        如果其他线程已经完成了重建则直接返回
+   *
+   * @param orig_version 调用者探测时看到的version_
+   */
+  void grow(uint64_t orig_version) {
+    auto all_locks_manager = lock_all();
+    if (version_.load(std::memory_order_relaxed) != orig_version) {
+      return;
+    }
+    const size_type hp = hashpower();
+    const size_type tombstones = tombstones_.load(std::memory_order_relaxed);
+    const bool sparse = tombstones * 4 > hashsize(hp) || tombstones > size();
+    rebuild(sparse ? hp : hp + 1);
+  }
+
+  /**
+   * @brief 将所有元素迁移到hashpower为new_hp的新slot数组中，同时清除所有墓碑；
+   *        arena中的无效字节超过一半时，同时压缩arena
+   * @pre 调用者已经通过lock_all()锁住了哈希表
+   */
+  void rebuild(size_type new_hp) {
+    const size_type hp = hashpower();
+    const bool compact = arena_.fragmented();
+    key_arena fresh_arena(allocator_);
+    slot* fresh = create_slots(new_hp);
+    std::vector<counter_type> counters(locks_.size(), 0);
+    for (size_type i = 0; i < hashsize(hp); ++i) {
+      slot& from = slots_[i];
+      if (!from.live()) {
+        continue;
+      }
+      size_type ind = index_hash(new_hp, from.hash);
+      while (fresh[ind].len != kEmptyLen) {
+        ind = index_hash(new_hp, ind + 1);
+      }
+      slot& to = fresh[ind];
+      traits_::construct(allocator_, &to.mapped(), std::move(from.mapped()));
+      // 只拷贝slot中的key区，长key仍然指向原来的arena
+      to.hash = from.hash;
+      to.len = from.len;
+      if (compact && from.len > InlineSize) {
+        const char* p = fresh_arena.store(from.data(), from.len);
+        memcpy(to.key, &p, sizeof(p));
+      } else {
+        memcpy(to.key, from.key, InlineSize);
+      }
+      ++counters[ind & (locks_.size() - 1)];
+    }
+    destroy_slots(slots_, hp);
+    slots_ = fresh;
+    if (compact) {
+      arena_.swap(fresh_arena);
+    }
+    for (size_type i = 0; i < locks_.size(); ++i) {
+      locks_[i].elem_counter() = counters[i];
+    }
+    tombstones_.store(0, std::memory_order_relaxed);
+    hashpower_.store(new_hp, std::memory_order_release);
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+  /// 用于构造value的allocator
+  allocator_type allocator_;
+  /// 用于申请slot数组的allocator
+  rebind_alloc<slot> slot_allocator_;
+  /// 保存长key的arena
+  key_arena arena_;
+  /// 当前的hashpower
+  std::atomic<size_type> hashpower_;
+  /// 当前的slot数组，只在持有对应自旋锁时访问
+  slot* slots_;
+  /// 上一次重建之后产生的墓碑个数
+  std::atomic<size_type> tombstones_;
+  /// slot数组被重建或清空的次数，加锁之后通过它判断slot的布局是否发生了变化
+  std::atomic<uint64_t> version_;
+  /// 按照slot交错分配的自旋锁，同时记录各自负责的元素个数
+  mutable locks_t locks_;
+};
+
+}  // namespace rbhash
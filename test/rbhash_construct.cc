@@ -3,6 +3,11 @@
 
 #include <gtest/gtest.h>
 
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
 // 默认构造
 TEST(Construct, DefaultSize)
 {
@@ -36,6 +41,37 @@ TEST(Construct, InitialList)
     }
 }
 
+TEST(Construct, BulkLoad)
+{
+    // 足够大的区间会走并行装载路径，随机的key会有部分元素越过区间边界
+    constexpr int kSize = 100000;
+    std::mt19937 gen(1);
+    std::set<int> keys;
+    while (keys.size() < kSize) {
+        keys.insert(gen() & 0x7fffffff);
+    }
+    std::vector<std::pair<int, int>> data;
+    for (int key : keys) {
+        data.emplace_back(key, key / 2);
+    }
+    // 区间内重复的key，先出现的胜出
+    data.emplace_back(data[0].first, -1);
+    data.emplace_back(data[1].first, -1);
+
+    IntIntTable tbl(data.begin(), data.end(), 1);
+    EXPECT_EQ(tbl.size(), kSize);
+    EXPECT_GE(tbl.capacity(), kSize);
+    for (int key : keys) {
+        ASSERT_EQ(tbl.find(key), key / 2) << key;
+    }
+
+    // 装载后的哈希表可以继续正常使用
+    EXPECT_TRUE(tbl.erase(data[0].first));
+    EXPECT_TRUE(tbl.insert(data[0].first, 0));
+    EXPECT_FALSE(tbl.insert(data[1].first, 0));
+    EXPECT_EQ(tbl.size(), kSize);
+}
+
 TEST(Construct, Move)
 {
     IntIntTable tbl({ { 1, 2 }, { 3, 4 }, { 5, 6 }, { 7, 8 } });
@@ -60,6 +96,38 @@ TEST(Construct, Zero)
     SUCCEED();
 }
 
+TEST(Construct, NumLocks)
+{
+    IntIntTable tbl(20);
+    const size_t locks = tbl.max_num_locks();
+    EXPECT_EQ(locks & (locks - 1), 0);
+    EXPECT_EQ(locks, IntIntTable::default_num_locks());
+
+    // 自旋锁占用的内存与哈希表大小无关
+    const size_t bucket_bytes = tbl.bucket_count() * sizeof(IntIntTable::buckets_t::bucket);
+    EXPECT_EQ(tbl.footprint() - bucket_bytes, locks * sizeof(rbhash::spinlock_t));
+
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+    tbl.max_num_locks(3);
+    EXPECT_EQ(tbl.max_num_locks(), 4);
+    EXPECT_EQ(tbl.size(), 1000);
+
+    // 扩容时复用已有的自旋锁集合
+    IntIntTable tbl2(1);
+    tbl2.max_num_locks(4);
+    for (int i = 0; i < (1 << 12); ++i) {
+        EXPECT_TRUE(tbl2.insert(i, i));
+        ASSERT_EQ(tbl2.size(), i + 1);
+    }
+    const size_t bucket_bytes2 = tbl2.bucket_count() * sizeof(IntIntTable::buckets_t::bucket);
+    EXPECT_LE(tbl2.footprint() - bucket_bytes2, 2 * 4 * sizeof(rbhash::spinlock_t));
+    for (int i = 0; i < (1 << 12); ++i) {
+        EXPECT_EQ(tbl2.find(i), i);
+    }
+}
+
 TEST(Stat, Size1)
 {
     IntIntTable tbl(0);
@@ -0,0 +1,133 @@
+#include "rbhash/counter_map.hpp"
+#include "rbhash/rbhash.hpp"
+#include "rbhash_test.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using Counter = rbhash::counter_map<uint64_t, uint64_t>;
+
+TEST(CounterMap, Basic)
+{
+    Counter tbl(1);
+    EXPECT_TRUE(tbl.empty());
+    for (uint64_t i = 0; i < 1024; ++i) {
+        EXPECT_EQ(tbl.fetch_add(i, i + 1), 0);
+        ASSERT_EQ(tbl.size(), i + 1);
+    }
+    for (uint64_t i = 0; i < 1024; ++i) {
+        EXPECT_EQ(tbl.fetch_add(i, 1), i + 1);
+    }
+    EXPECT_GE(tbl.capacity(), 1024);
+
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < 1024; ++i) {
+        EXPECT_TRUE(tbl.find(i, value));
+        EXPECT_EQ(value, i + 2);
+    }
+    EXPECT_FALSE(tbl.find(1024, value));
+    EXPECT_THROW(tbl.find(1024), std::out_of_range);
+    EXPECT_FALSE(tbl.contains(1024));
+
+    EXPECT_EQ(tbl.fetch_sub(3, 5), 5);
+    EXPECT_EQ(tbl.find(3), 0);
+    EXPECT_TRUE(tbl.contains(3));
+    EXPECT_FALSE(tbl.insert(3, 100));
+    EXPECT_TRUE(tbl.insert(2000, 100));
+    EXPECT_EQ(tbl.find(2000), 100);
+
+    EXPECT_THROW(tbl.fetch_add(Counter::empty_key(), 1), std::invalid_argument);
+    EXPECT_THROW(tbl.insert(Counter::deleted_key(), 1), std::invalid_argument);
+    EXPECT_FALSE(tbl.contains(Counter::empty_key()));
+}
+
+TEST(CounterMap, FloatingPoint)
+{
+    rbhash::counter_map<int, double> tbl(4);
+    EXPECT_EQ(tbl.fetch_add(1, 0.5), 0.0);
+    EXPECT_EQ(tbl.fetch_add(1, 0.25), 0.5);
+    EXPECT_EQ(tbl.fetch_sub(1, 1.0), 0.75);
+    EXPECT_EQ(tbl.find(1), -0.25);
+}
+
+TEST(CounterMap, EraseAndClear)
+{
+    Counter tbl(4);
+    constexpr uint64_t size = 1 << 12;
+    for (uint64_t i = 0; i < size; ++i) {
+        tbl.fetch_add(i, 1);
+    }
+    for (uint64_t i = 0; i < size; i += 2) {
+        EXPECT_TRUE(tbl.erase(i));
+        EXPECT_FALSE(tbl.erase(i));
+    }
+    EXPECT_EQ(tbl.size(), size / 2);
+    for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_EQ(tbl.contains(i), i % 2 == 1) << i;
+    }
+    // 删除之后重新计数
+    EXPECT_EQ(tbl.fetch_add(0, 1), 0);
+    EXPECT_EQ(tbl.find(0), 1);
+
+    tbl.reserve(tbl.capacity() * 2);
+    EXPECT_EQ(tbl.find(1), 1);
+    EXPECT_EQ(tbl.size(), size / 2 + 1);
+
+    const size_t capacity = tbl.capacity();
+    tbl.clear();
+    EXPECT_TRUE(tbl.empty());
+    EXPECT_EQ(tbl.capacity(), capacity);
+    EXPECT_FALSE(tbl.contains(1));
+    EXPECT_EQ(tbl.fetch_add(1, 1), 0);
+
+    // 历史数组保留到purge()为止
+    const size_t footprint = tbl.footprint();
+    tbl.purge();
+    EXPECT_LT(tbl.footprint(), footprint);
+    EXPECT_EQ(tbl.find(1), 1);
+}
+
+TEST(CounterMap, MultiThreading)
+{
+    // 从最小容量开始，累加与多次扩容并发，任何一次累加都不能丢失
+    Counter tbl(1);
+    constexpr uint64_t num_keys = 1 << 12;
+    constexpr uint64_t rounds = 1 << 16;
+    constexpr int num_threads = 4;
+
+    auto worker = [&](uint64_t id) {
+        uint64_t x = id + 1;
+        for (uint64_t i = 0; i < rounds; ++i) {
+            // 一半的累加集中在少数几个热点key上
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            const uint64_t key = (x >> 33) % ((i & 1) ? num_keys : 8);
+            tbl.fetch_add(key, 1);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(worker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < num_keys; ++i) {
+        uint64_t value = 0;
+        if (tbl.find(i, value)) {
+            total += value;
+        }
+    }
+    EXPECT_EQ(total, rounds * num_threads);
+    EXPECT_LE(tbl.size(), num_keys);
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,142 @@
+#include "rbhash/insert_only_map.hpp"
+#include "rbhash/rbhash.hpp"
+#include "rbhash_test.h"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using IntIntInsertOnlyTable = rbhash::insert_only_map<int, int>;
+
+TEST(InsertOnly, Basic)
+{
+    IntIntInsertOnlyTable tbl(1);
+    EXPECT_TRUE(tbl.empty());
+    EXPECT_EQ(tbl.capacity(), 2);
+
+    for (int i = 0; i < 1024; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i + 1));
+        ASSERT_EQ(tbl.size(), i + 1);
+    }
+    for (int i = 0; i < 1024; ++i) {
+        EXPECT_FALSE(tbl.insert(i, 0));
+    }
+    EXPECT_GE(tbl.capacity(), 1024);
+
+    int value = 0;
+    for (int i = 0; i < 1024; ++i) {
+        EXPECT_TRUE(tbl.find(i, value));
+        EXPECT_EQ(value, i + 1);
+        EXPECT_EQ(tbl.find(i), i + 1);
+        EXPECT_TRUE(tbl.contains(i));
+    }
+    EXPECT_FALSE(tbl.find(1024, value));
+    EXPECT_FALSE(tbl.contains(-1));
+    EXPECT_THROW(tbl.find(2048), std::out_of_range);
+
+    // 释放历史表后数据依然完整
+    const size_t footprint = tbl.footprint();
+    tbl.purge();
+    EXPECT_LT(tbl.footprint(), footprint);
+    for (int i = 0; i < 1024; ++i) {
+        EXPECT_EQ(tbl.find(i), i + 1);
+    }
+}
+
+TEST(InsertOnly, StringKey)
+{
+    constexpr int size = 1 << 12;
+    rbhash::insert_only_map<std::string, int> tbl(4);
+    for (int i = 0; i < size; ++i) {
+        EXPECT_TRUE(tbl.insert(generateKey<std::string>(i), i));
+    }
+    for (int i = 0; i < size; ++i) {
+        EXPECT_EQ(i, tbl.find(generateKey<std::string>(i)));
+    }
+    EXPECT_EQ(tbl.size(), size);
+}
+
+TEST(InsertOnly, Reserve)
+{
+    IntIntInsertOnlyTable tbl(1);
+    tbl.insert(1, 1);
+    tbl.reserve(1000);
+    EXPECT_EQ(tbl.capacity(), 1024);
+    EXPECT_EQ(tbl.find(1), 1);
+}
+
+// 参数为负数时构造失败
+struct ThrowOnNegative {
+    ThrowOnNegative(int v) : value(v)
+    {
+        if (v < 0) {
+            throw std::invalid_argument("negative");
+        }
+    }
+    int value;
+};
+
+TEST(InsertOnly, ConstructorThrows)
+{
+    rbhash::insert_only_map<int, ThrowOnNegative> tbl(1);
+    EXPECT_THROW(tbl.insert(1, -1), std::invalid_argument);
+    EXPECT_FALSE(tbl.contains(1));
+    EXPECT_EQ(tbl.size(), 0);
+
+    // 作废的slot不影响之后的插入、查找和扩容
+    EXPECT_TRUE(tbl.insert(1, 1));
+    EXPECT_FALSE(tbl.insert(1, 2));
+    for (int i = 2; i < 1024; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+        EXPECT_THROW(tbl.insert(-i, -i), std::invalid_argument);
+    }
+    EXPECT_EQ(tbl.size(), 1023);
+    for (int i = 1; i < 1024; ++i) {
+        EXPECT_EQ(tbl.find(i).value, i);
+        EXPECT_FALSE(tbl.contains(-i));
+    }
+}
+
+TEST(InsertOnly, MultiThreading)
+{
+    rbhash::insert_only_map<uint64_t, uint64_t> tbl(1);
+    constexpr uint64_t counter = 1 << 14;
+    constexpr int num_threads = 4;
+    std::atomic<uint64_t> inserted(0);
+
+    // 所有线程插入相同的key集合，每个key只能被成功插入一次
+    auto insertWorker = [&](int id) {
+        for (uint64_t i = 0; i < counter; ++i) {
+            const uint64_t key = (i + id * counter / num_threads) % counter;
+            if (tbl.insert(key, key)) {
+                inserted.fetch_add(1, std::memory_order_relaxed);
+            }
+            uint64_t value = 0;
+            EXPECT_TRUE(tbl.find(key, value)) << key;
+            EXPECT_EQ(value, key);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(insertWorker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(inserted.load(), counter);
+    EXPECT_EQ(tbl.size(), counter);
+    for (uint64_t i = 0; i < counter; ++i) {
+        EXPECT_EQ(tbl.find(i), i);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,204 @@
+#include "rbhash/int_map.hpp"
+#include "rbhash/rbhash.hpp"
+#include "rbhash_test.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using IntIntMap = rbhash::int_map<uint64_t, uint64_t>;
+
+TEST(IntMap, Basic)
+{
+    IntIntMap tbl(1);
+    EXPECT_TRUE(tbl.empty());
+    EXPECT_EQ(tbl.capacity(), 2);
+
+    for (uint64_t i = 0; i < 1024; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i + 1));
+        ASSERT_EQ(tbl.size(), i + 1);
+    }
+    for (uint64_t i = 0; i < 1024; ++i) {
+        EXPECT_FALSE(tbl.insert(i, 0));
+    }
+    EXPECT_GE(tbl.capacity(), 1024);
+
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < 1024; ++i) {
+        EXPECT_TRUE(tbl.find(i, value));
+        EXPECT_EQ(value, i + 1);
+        EXPECT_EQ(tbl.find(i), i + 1);
+        EXPECT_TRUE(tbl.contains(i));
+    }
+    EXPECT_FALSE(tbl.find(1024, value));
+    EXPECT_THROW(tbl.find(1024), std::out_of_range);
+
+    EXPECT_TRUE(tbl.update(1, 100));
+    EXPECT_EQ(tbl.find(1), 100);
+    EXPECT_FALSE(tbl.update(2000, 100));
+    EXPECT_FALSE(tbl.insert_or_assign(2, 200));
+    EXPECT_EQ(tbl.find(2), 200);
+    EXPECT_TRUE(tbl.insert_or_assign(2000, 1));
+    EXPECT_FALSE(tbl.upsert(3, [](uint64_t& v) { v *= 10; }, 0));
+    EXPECT_EQ(tbl.find(3), 40);
+    EXPECT_TRUE(tbl.update_fn(3, [](uint64_t& v) { ++v; }));
+    EXPECT_EQ(tbl.find(3), 41);
+    EXPECT_EQ(tbl.size(), 1025);
+
+    // 每个slot只有key和value
+    EXPECT_LT(tbl.footprint(), tbl.capacity() * 16 + (1 << 20));
+}
+
+TEST(IntMap, ReservedKey)
+{
+    IntIntMap tbl(4);
+    EXPECT_THROW(tbl.insert(IntIntMap::empty_key(), 1), std::invalid_argument);
+    EXPECT_THROW(tbl.insert(IntIntMap::deleted_key(), 1), std::invalid_argument);
+    EXPECT_FALSE(tbl.contains(IntIntMap::empty_key()));
+    EXPECT_FALSE(tbl.erase(IntIntMap::deleted_key()));
+    EXPECT_TRUE(tbl.empty());
+
+    // 自定义哨兵之后，默认的哨兵可以作为普通key
+    rbhash::int_map<int, int, std::hash<int>, std::allocator<std::pair<const int, int>>, -1, -2> tbl2(4);
+    EXPECT_TRUE(tbl2.insert(std::numeric_limits<int>::max(), 1));
+    EXPECT_TRUE(tbl2.insert(0, 0));
+    EXPECT_THROW(tbl2.insert(-1, 1), std::invalid_argument);
+    EXPECT_EQ(tbl2.find(std::numeric_limits<int>::max()), 1);
+}
+
+TEST(IntMap, EraseAndClear)
+{
+    rbhash::int_map<int, std::unique_ptr<int>> tbl(4);
+    constexpr int size = 1 << 12;
+    for (int i = 0; i < size; ++i) {
+        EXPECT_TRUE(tbl.insert(i, new int(i)));
+    }
+    for (int i = 0; i < size; i += 2) {
+        EXPECT_TRUE(tbl.erase(i));
+        EXPECT_FALSE(tbl.erase(i));
+    }
+    EXPECT_EQ(tbl.size(), size / 2);
+    for (int i = 0; i < size; ++i) {
+        EXPECT_EQ(tbl.contains(i), i % 2 == 1) << i;
+    }
+    EXPECT_TRUE(tbl.find_fn(1, [](const std::unique_ptr<int>& p) { EXPECT_EQ(*p, 1); }));
+
+    // 删除之后可以重新插入
+    for (int i = 0; i < size; i += 2) {
+        EXPECT_TRUE(tbl.insert(i, new int(-i)));
+    }
+    EXPECT_EQ(tbl.size(), size);
+
+    const size_t capacity = tbl.capacity();
+    tbl.reserve(capacity * 2);
+    EXPECT_EQ(tbl.capacity(), capacity * 2);
+    EXPECT_TRUE(tbl.find_fn(2, [](const std::unique_ptr<int>& p) { EXPECT_EQ(*p, -2); }));
+
+    tbl.clear();
+    EXPECT_TRUE(tbl.empty());
+    EXPECT_EQ(tbl.capacity(), capacity * 2);
+    EXPECT_FALSE(tbl.contains(1));
+    EXPECT_TRUE(tbl.insert(1, new int(1)));
+}
+
+struct ZeroHash {
+    size_t operator()(uint64_t) const { return 0; }
+};
+
+TEST(IntMap, TombstoneBeforeKey)
+{
+    // 所有key落在同一个slot上，key 2位于key 1的墓碑之后，不能被再次插入
+    rbhash::int_map<uint64_t, uint64_t, ZeroHash> tbl(4);
+    EXPECT_TRUE(tbl.insert(1, 1));
+    EXPECT_TRUE(tbl.insert(2, 2));
+    EXPECT_TRUE(tbl.erase(1));
+    EXPECT_FALSE(tbl.insert(2, 99));
+    EXPECT_EQ(tbl.find(2), 2);
+    EXPECT_FALSE(tbl.insert_or_assign(2, 99));
+    EXPECT_EQ(tbl.find(2), 99);
+    EXPECT_EQ(tbl.size(), 1);
+    EXPECT_TRUE(tbl.erase(2));
+    EXPECT_FALSE(tbl.contains(2));
+    EXPECT_TRUE(tbl.empty());
+
+    // 反复插入删除产生的墓碑通过原容量重建回收
+    for (uint64_t i = 0; i < 1024; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+        EXPECT_TRUE(tbl.erase(i));
+    }
+    EXPECT_TRUE(tbl.empty());
+    EXPECT_LE(tbl.capacity(), 64);
+}
+
+TEST(IntMap, Mixer)
+{
+    // 间隔为2^12的key，恒等哈希下全部落在同一个slot上
+    IntIntMap tbl(10);
+    EXPECT_EQ(tbl.mixer(), rbhash::hash_mixer::fibonacci);
+    for (uint64_t i = 0; i < 512; ++i) {
+        EXPECT_TRUE(tbl.insert(i << 12, i));
+    }
+    EXPECT_EQ(tbl.capacity(), 1 << 10);
+    tbl.mixer(rbhash::hash_mixer::murmur);
+    for (uint64_t i = 0; i < 512; ++i) {
+        EXPECT_EQ(tbl.find(i << 12), i);
+    }
+}
+
+TEST(IntMap, MultiThreading)
+{
+    IntIntMap tbl(1);
+    constexpr uint64_t counter = 1 << 14;
+    constexpr int num_threads = 4;
+    std::atomic<uint64_t> inserted(0);
+
+    // 所有线程插入相同的key集合，每个key只能被成功插入一次
+    auto insertWorker = [&](int id) {
+        for (uint64_t i = 0; i < counter; ++i) {
+            const uint64_t key = (i + id * counter / num_threads) % counter;
+            if (tbl.insert(key, key)) {
+                inserted.fetch_add(1, std::memory_order_relaxed);
+            }
+            uint64_t value = 0;
+            EXPECT_TRUE(tbl.find(key, value)) << key;
+            EXPECT_EQ(value, key);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(insertWorker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(inserted.load(), counter);
+    EXPECT_EQ(tbl.size(), counter);
+
+    // 并发删除一半的key，同时查找另一半
+    auto eraseWorker = [&](int id) {
+        for (uint64_t i = id; i < counter; i += num_threads) {
+            if (i % 2 == 0) {
+                EXPECT_TRUE(tbl.erase(i));
+            } else {
+                EXPECT_EQ(tbl.find(i), i);
+            }
+        }
+    };
+    threads.clear();
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(eraseWorker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(tbl.size(), counter / 2);
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -3,6 +3,10 @@
 
 #include <gtest/gtest.h>
 
+#include <map>
+#include <set>
+#include <thread>
+
 TEST(Iterate, Basic)
 {
     IntIntTable tbl(1);
@@ -135,6 +139,209 @@ TEST(Iterate, Moderate)
     }
 }
 
+TEST(Iterate, ForEach)
+{
+    IntIntTable tbl(4);
+    constexpr int kSize = 1024;
+    for (int i = 0; i < kSize; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+
+    std::map<int, int> seen;
+    tbl.for_each([&](const int& k, int& v) {
+        ++seen[k];
+        EXPECT_EQ(k, v);
+        v = -k;
+    });
+    EXPECT_EQ(seen.size(), kSize);
+    for (const auto& p : seen) {
+        EXPECT_EQ(p.second, 1);
+        EXPECT_EQ(tbl.find(p.first), -p.first);
+    }
+}
+
+TEST(Iterate, ForEachConcurrentResize)
+{
+    IntIntTable tbl(1);
+    constexpr int kSize = 4096;
+    for (int i = 0; i < kSize; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+
+    // 遍历期间并发插入（触发扩容）和删除新插入的元素
+    std::atomic<bool> finished(false);
+    std::thread writer([&]() {
+        for (int i = kSize; !finished.load() && i < 64 * kSize; ++i) {
+            EXPECT_TRUE(tbl.insert(i, i));
+            if (i % 3 == 0) {
+                EXPECT_TRUE(tbl.erase(i));
+            }
+        }
+    });
+
+    for (int round = 0; round < 4; ++round) {
+        std::set<int> seen;
+        tbl.for_each([&](const int& k, int& v) {
+            EXPECT_EQ(k, v);
+            seen.insert(k);
+        });
+        // 遍历期间一直存在的元素至少被访问一次
+        for (int i = 0; i < kSize; ++i) {
+            EXPECT_TRUE(seen.count(i)) << i;
+        }
+    }
+    finished.store(true);
+    writer.join();
+}
+
+TEST(Iterate, Scan)
+{
+    IntIntTable tbl(4);
+    constexpr int kSize = 1000;
+    for (int i = 0; i < kSize; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+
+    std::multiset<int> seen;
+    size_t cursor = 0;
+    do {
+        cursor = tbl.scan(cursor, 10, [&](const int& k, int& v) {
+            EXPECT_EQ(k, v);
+            seen.insert(k);
+        });
+    } while (cursor != 0);
+    // 遍历期间哈希表没有变化时，每个元素恰好被访问一次
+    EXPECT_EQ(seen.size(), kSize);
+    for (int i = 0; i < kSize; ++i) {
+        EXPECT_EQ(seen.count(i), 1) << i;
+    }
+
+    IntIntTable empty(4);
+    EXPECT_EQ(empty.scan(0, 10, [](const int&, int&) { FAIL(); }), 0);
+}
+
+TEST(Iterate, ScanAcrossResize)
+{
+    IntIntTable tbl(4);
+    constexpr int kSize = 1000;
+    for (int i = 0; i < kSize; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+
+    // 两次调用之间插入大量元素触发多次扩容
+    std::set<int> seen;
+    size_t cursor = 0;
+    int next = kSize;
+    do {
+        cursor = tbl.scan(cursor, 50, [&](const int& k, int&) { seen.insert(k); });
+        for (int i = 0; i < 200; ++i, ++next) {
+            EXPECT_TRUE(tbl.insert(next, next));
+        }
+    } while (cursor != 0);
+    EXPECT_GT(tbl.capacity(), 2 * kSize);
+    for (int i = 0; i < kSize; ++i) {
+        EXPECT_TRUE(seen.count(i)) << i;
+    }
+}
+
+TEST(Iterate, ParallelForEachReduce)
+{
+    IntIntTable tbl(4);
+    tbl.max_num_worker_threads(3);
+    {
+        auto locked = tbl.lock_table();
+        EXPECT_EQ(locked.parallel_reduce(
+                      7, [](const int&, const int&) { return 1; },
+                      [](int a, int b) { return a + b; }),
+            7);
+    }
+
+    constexpr int kSize = 10000;
+    for (int i = 0; i < kSize; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+    for (int i = 0; i < kSize; i += 2) {
+        EXPECT_TRUE(tbl.erase(i));
+    }
+
+    auto locked = tbl.lock_table();
+    locked.parallel_for_each([](const int& k, int& v) { v = 2 * k; });
+    for (const auto& p : locked) {
+        EXPECT_EQ(p.second, 2 * p.first);
+    }
+
+    const int64_t sum = locked.parallel_reduce(
+        int64_t(0), [](const int& k, const int&) { return int64_t(k); },
+        [](int64_t a, int64_t b) { return a + b; });
+    EXPECT_EQ(sum, int64_t(kSize / 2) * (kSize / 2));
+    const int max = locked.parallel_reduce(
+        -1, [](const int&, const int& v) { return v; },
+        [](int a, int b) { return std::max(a, b); });
+    EXPECT_EQ(max, 2 * (kSize - 1));
+
+    // 工作线程中抛出的异常会被传递给调用者
+    EXPECT_THROW(locked.parallel_for_each([](const int& k, int&) {
+        if (k == 1) {
+            throw std::runtime_error("stop");
+        }
+    }),
+        std::runtime_error);
+}
+
+TEST(Iterate, LockedTableOperation)
+{
+    IntIntTable tbl(1);
+    constexpr int kSize = 4096;
+    {
+        auto locked = tbl.lock_table();
+        // 插入过程中会在持锁的情况下扩容
+        for (int i = 0; i < kSize; ++i) {
+            auto res = locked.insert(i, i);
+            EXPECT_TRUE(res.second);
+            EXPECT_EQ(res.first->first, i);
+        }
+        auto res = locked.emplace(1, 100);
+        EXPECT_FALSE(res.second);
+        EXPECT_EQ(res.first->second, 1);
+
+        for (int i = 0; i < kSize; ++i) {
+            auto it = locked.find(i);
+            ASSERT_TRUE(it != locked.end());
+            EXPECT_EQ(it->second, i);
+            EXPECT_EQ(locked.count(i), 1);
+        }
+        EXPECT_TRUE(locked.find(kSize) == locked.end());
+        EXPECT_EQ(locked.count(kSize), 0);
+
+        locked[kSize] = -1;
+        locked[0] += 10;
+        EXPECT_EQ(locked.find(kSize)->second, -1);
+        EXPECT_EQ(locked[0], 10);
+
+        EXPECT_EQ(locked.erase(kSize), 1);
+        EXPECT_EQ(locked.erase(kSize), 0);
+        for (auto it = locked.begin(); it != locked.end();) {
+            if (it->first % 2 == 0) {
+                it = locked.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        const auto& clocked = locked;
+        EXPECT_TRUE(clocked.find(0) == clocked.end());
+        EXPECT_EQ(clocked.find(1)->second, 1);
+    }
+
+    // 解锁之后普通接口可以看到所有修改
+    EXPECT_EQ(tbl.size(), kSize / 2);
+    EXPECT_GE(tbl.capacity(), kSize);
+    for (int i = 0; i < kSize; ++i) {
+        int value = 0;
+        EXPECT_EQ(tbl.find(i, value), i % 2 == 1) << i;
+    }
+    EXPECT_TRUE(tbl.insert(kSize, kSize));
+}
+
 int main(int argc, char* argv[])
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -1,4 +1,5 @@
 #include "rbhash/rbhash.hpp"
+#include "rbhash/string_hash.hpp"
 #include "rbhash_test.h"
 
 #include <gtest/gtest.h>
@@ -92,6 +93,43 @@ TEST(Operation, Clear)
     }
 }
 
+TEST(Operation, TrivialTypes)
+{
+    struct Point {
+        int32_t x;
+        int32_t y;
+    };
+    // 可按字节拷贝的键值：扩容时整体拷贝bucket，清空时直接清零
+    rbhash::map<uint64_t, Point> tbl(1);
+    constexpr uint64_t size = 1 << 12;
+    for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_TRUE(tbl.insert(i, Point { int32_t(i), -int32_t(i) }));
+    }
+    for (uint64_t i = 0; i < size; i += 2) {
+        EXPECT_TRUE(tbl.erase(i));
+    }
+    EXPECT_TRUE(tbl.rehash(tbl.hashpower() + 1));
+    EXPECT_EQ(tbl.size(), size / 2);
+    for (uint64_t i = 0; i < size; ++i) {
+        Point p {};
+        EXPECT_EQ(tbl.find(i, p), i % 2 == 1) << i;
+        if (i % 2 == 1) {
+            EXPECT_EQ(p.x, int32_t(i));
+            EXPECT_EQ(p.y, -int32_t(i));
+        }
+    }
+
+    const size_t capacity = tbl.capacity();
+    tbl.clear();
+    EXPECT_EQ(tbl.size(), 0);
+    EXPECT_EQ(tbl.capacity(), capacity);
+    for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_FALSE(tbl.erase(i));
+        EXPECT_TRUE(tbl.insert(i, Point { 0, 0 }));
+    }
+    EXPECT_EQ(tbl.size(), size);
+}
+
 TEST(Operation, Find)
 {
     rbhash::map<int, Data> tbl(10);
@@ -188,6 +226,52 @@ TEST(Operation, Rehash)
     EXPECT_EQ(tbl.capacity(), 1 << 10);
 }
 
+TEST(Operation, ExpandInPlace)
+{
+    // bucket数组达到HASHMAP_MMAP_MIN_BYTES之后通过mremap原地翻倍，扩容时表中有删除标志
+    constexpr uint64_t size = 1 << 19;
+    constexpr uint64_t lag = 1000;
+    auto present = [&](uint64_t k) { return k % 3 != 0 || k + lag >= size; };
+    rbhash::map<uint64_t, uint64_t> tbl(16);
+    tbl.max_num_worker_threads(3);
+    for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+        if (i >= lag && !present(i - lag)) {
+            EXPECT_TRUE(tbl.erase(i - lag));
+        }
+    }
+#ifdef __linux__
+    EXPECT_EQ(tbl.stat().find("\"nr_expand_in_place\":0"), std::string::npos)
+        << tbl.stat();
+#endif
+    uint64_t expected = 0;
+    for (uint64_t i = 0; i < size; ++i) {
+        uint64_t value = 0;
+        ASSERT_EQ(tbl.find(i, value), present(i)) << i;
+        if (present(i)) {
+            EXPECT_EQ(value, i);
+            ++expected;
+        }
+    }
+    EXPECT_EQ(tbl.size(), expected);
+
+    uint64_t count = 0;
+    {
+        auto lt = tbl.lock_table();
+        for (const auto& kv : lt) {
+            EXPECT_EQ(kv.first, kv.second);
+            ++count;
+        }
+    }
+    EXPECT_EQ(count, expected);
+
+    // 翻倍之后元素计数仍然与各个自旋锁对应
+    for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_EQ(tbl.erase(i), present(i));
+    }
+    EXPECT_TRUE(tbl.empty());
+}
+
 TEST(Operation, Reserve)
 {
     IntIntTable tbl(10);
@@ -196,6 +280,554 @@ TEST(Operation, Reserve)
     EXPECT_EQ(tbl.capacity(), 16);
 }
 
+// 统计构造、拷贝和移动次数的value类型
+struct Tracked {
+    static int constructed, copied, moved;
+    int v = 0;
+    Tracked(int x = 0)
+        : v(x)
+    {
+        ++constructed;
+    }
+    Tracked(const Tracked& o)
+        : v(o.v)
+    {
+        ++copied;
+    }
+    Tracked(Tracked&& o) noexcept
+        : v(o.v)
+    {
+        ++moved;
+    }
+    Tracked& operator=(const Tracked& o)
+    {
+        v = o.v;
+        ++copied;
+        return *this;
+    }
+    Tracked& operator=(Tracked&& o) noexcept
+    {
+        v = o.v;
+        ++moved;
+        return *this;
+    }
+    static void clear() { constructed = copied = moved = 0; }
+};
+int Tracked::constructed = 0;
+int Tracked::copied = 0;
+int Tracked::moved = 0;
+
+TEST(Operation, TryEmplace)
+{
+    rbhash::map<int, Tracked> tbl(4);
+    Tracked::clear();
+    EXPECT_TRUE(tbl.try_emplace(1, 10));
+    EXPECT_EQ(Tracked::constructed, 1);
+    EXPECT_FALSE(tbl.try_emplace(1, 20));
+    EXPECT_EQ(Tracked::constructed, 1);
+    EXPECT_EQ(tbl.find_ptr(1)->v, 10);
+
+    // factory只在key不存在时调用
+    int calls = 0;
+    auto factory = [&calls]() {
+        ++calls;
+        return Tracked(30);
+    };
+    {
+        auto ptr = tbl.get_or_insert_with(2, factory);
+        ASSERT_TRUE(ptr);
+        EXPECT_EQ(ptr->v, 30);
+    }
+    {
+        auto ptr = tbl.get_or_insert_with(1, factory);
+        EXPECT_EQ(ptr->v, 10);
+    }
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(Tracked::copied, 0);
+
+    // 右值的insert_or_assign在插入和赋值时都不拷贝
+    Tracked::clear();
+    EXPECT_TRUE(tbl.insert_or_assign(3, Tracked(40)));
+    EXPECT_FALSE(tbl.insert_or_assign(3, Tracked(50)));
+    EXPECT_EQ(Tracked::copied, 0);
+    EXPECT_EQ(Tracked::moved, 2);
+    EXPECT_EQ(tbl.find_ptr(3)->v, 50);
+
+    // 左值仍然拷贝，且不修改原对象
+    Tracked lvalue(60);
+    EXPECT_FALSE(tbl.insert_or_assign(3, lvalue));
+    EXPECT_EQ(Tracked::copied, 1);
+    EXPECT_EQ(tbl.find_ptr(3)->v, 60);
+
+    // 只能移动的value
+    rbhash::map<int, std::unique_ptr<int>> uptbl(4);
+    EXPECT_TRUE(uptbl.insert_or_assign(1, std::unique_ptr<int>(new int(1))));
+    EXPECT_FALSE(uptbl.insert_or_assign(1, std::unique_ptr<int>(new int(2))));
+    EXPECT_EQ(**uptbl.find_ptr(1), 2);
+    EXPECT_FALSE(uptbl.try_emplace(1, nullptr));
+    EXPECT_EQ(**uptbl.find_ptr(1), 2);
+}
+
+TEST(Operation, FindPtr)
+{
+    StringIntTable tbl(4);
+    EXPECT_TRUE(tbl.insert("a", 1));
+    EXPECT_TRUE(tbl.insert("b", 2));
+
+    {
+        auto ptr = tbl.find_ptr(std::string("a"));
+        ASSERT_TRUE(ptr);
+        EXPECT_EQ(ptr.key(), "a");
+        EXPECT_EQ(*ptr, 1);
+        *ptr = 10;
+
+        // 移动后原句柄为空，锁随句柄转移
+        auto moved = std::move(ptr);
+        EXPECT_TRUE(ptr.empty());
+        EXPECT_EQ(*moved, 10);
+        moved.reset();
+        EXPECT_FALSE(moved);
+    }
+    EXPECT_EQ(tbl.find("a"), 10);
+
+    // 未命中时返回空句柄，不抛异常
+    auto miss = tbl.find_ptr(std::string("c"));
+    EXPECT_FALSE(miss);
+    EXPECT_TRUE(miss.empty());
+
+    const StringIntTable& ctbl = tbl;
+    StringIntTable::const_locked_ptr cptr = ctbl.find_ptr(std::string("b"));
+    ASSERT_TRUE(cptr);
+    EXPECT_EQ(*cptr, 2);
+    cptr.reset();
+
+    // 句柄释放后可以继续修改
+    EXPECT_TRUE(tbl.erase("b"));
+}
+
+TEST(MultiThreading, FindPtr)
+{
+    IntIntTable tbl(4);
+    constexpr int kThreads = 4;
+    constexpr int kRounds = 10000;
+    EXPECT_TRUE(tbl.insert(0, 0));
+
+    // 句柄持有自旋锁，读-改-写不会丢失更新
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back([&]() {
+            for (int r = 0; r < kRounds; ++r) {
+                auto ptr = tbl.find_ptr(0);
+                ASSERT_TRUE(ptr);
+                int v = *ptr;
+                *ptr = v + 1;
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(tbl.find(0), kThreads * kRounds);
+}
+
+TEST(Operation, PrecomputedHash)
+{
+    StringIntTable tbl1(4), tbl2(4);
+    const std::string key = generateKey<std::string>(42);
+    const auto hv = tbl1.hash_of(key);
+    EXPECT_EQ(hv.hash, tbl2.hash_of(key).hash);
+    EXPECT_EQ(hv.hash, tbl1.hash_of(key.c_str()).hash);
+
+    // 一次哈希，多个表共用
+    EXPECT_TRUE(tbl1.insert(hv, key, 1));
+    EXPECT_FALSE(tbl1.insert(hv, key, 2));
+    EXPECT_TRUE(tbl2.upsert(hv, key, [](int& v) { ++v; }, 10));
+    EXPECT_FALSE(tbl2.upsert(hv, key, [](int& v) { ++v; }, 10));
+
+    int value = 0;
+    EXPECT_TRUE(tbl1.find(hv, key, value));
+    EXPECT_EQ(value, 1);
+    EXPECT_EQ(tbl2.find(hv, key), 11);
+    EXPECT_EQ(tbl2.find(key), 11);
+    EXPECT_TRUE(tbl1.update_fn(hv, key, [](int& v) { v = 5; }));
+    EXPECT_EQ(tbl1.find(key), 5);
+
+    EXPECT_TRUE(tbl1.erase(hv, key));
+    EXPECT_FALSE(tbl1.erase(hv, key));
+    EXPECT_FALSE(tbl1.find(hv, key, value));
+    EXPECT_THROW(tbl1.find(hv, key), std::out_of_range);
+
+    // 使用预先计算的哈希值插入的元素，可以使用普通接口访问
+    IntIntTable itbl(1);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(itbl.insert(itbl.hash_of(i), i, i));
+    }
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(itbl.find(i), i);
+    }
+}
+
+TEST(Operation, HashMixer)
+{
+    // 间隔为2^12的整数key，恒等哈希下全部落在同一个bucket上
+    constexpr int stride = 1 << 12;
+    constexpr int size = 512;
+    IntIntTable plain(10), mixed(10);
+    mixed.mixer(rbhash::hash_mixer::fibonacci);
+    EXPECT_EQ(plain.mixer(), rbhash::hash_mixer::identity);
+    EXPECT_EQ(mixed.mixer(), rbhash::hash_mixer::fibonacci);
+    for (int i = 0; i < size; ++i) {
+        EXPECT_TRUE(plain.insert(i * stride, i));
+        EXPECT_TRUE(mixed.insert(i * stride, i));
+    }
+    EXPECT_EQ(mixed.capacity(), 1 << 10);
+    EXPECT_EQ(mixed.seed(), 0);
+    // 恒等哈希下探测过长，被当作哈希冲突处理，更换了种子（参见CollisionFlood）
+    EXPECT_NE(plain.seed(), 0);
+
+    // 非空时切换混合策略，所有元素按新策略重新放置
+    const auto hv = mixed.hash_of(stride);
+    mixed.mixer(rbhash::hash_mixer::murmur);
+    EXPECT_NE(mixed.hash_of(stride).hash, hv.hash);
+    EXPECT_EQ(mixed.size(), size);
+    for (int i = 0; i < size; ++i) {
+        EXPECT_EQ(mixed.find(i * stride), i);
+    }
+    for (int i = 0; i < size; i += 2) {
+        EXPECT_TRUE(mixed.erase(i * stride));
+    }
+    mixed.mixer(rbhash::hash_mixer::identity);
+    int value = 0;
+    for (int i = 0; i < size; ++i) {
+        EXPECT_EQ(mixed.find(i * stride, value), i % 2 == 1) << i;
+    }
+}
+
+TEST(Operation, CollisionFlood)
+{
+    // 低20位全部相同的key，不使用种子时全部落在同一个bucket上
+    constexpr uint64_t size = 1 << 12;
+    rbhash::map<uint64_t, uint64_t> tbl(4);
+    EXPECT_EQ(tbl.seed(), 0);
+    for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_TRUE(tbl.insert(i << 20, i));
+    }
+    // 更换种子之后不再持续翻倍
+    EXPECT_NE(tbl.seed(), 0);
+    EXPECT_LE(tbl.capacity(), size * 4);
+    EXPECT_NE(tbl.stat().find("\"nr_reseed\":1"), std::string::npos) << tbl.stat();
+    for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_EQ(tbl.find(i << 20), i);
+    }
+
+    // 种子只影响bucket索引，预先计算的哈希值仍然有效
+    const auto hv = tbl.hash_of(uint64_t(1) << 20);
+    tbl.seed(rbhash::random_seed());
+    EXPECT_EQ(tbl.hash_of(uint64_t(1) << 20).hash, hv.hash);
+    EXPECT_EQ(tbl.find(hv, uint64_t(1) << 20), 1);
+    // 去掉种子之后重新放置时再次检测到冲突，自动换用了新的种子
+    tbl.seed(0);
+    EXPECT_NE(tbl.seed(), 0);
+    for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_EQ(tbl.find(i << 20), i);
+    }
+}
+
+TEST(Operation, ReseedInPlace)
+{
+    // 第一次探测过长时负载率很低，仍然翻倍；第二次在原容量上更换种子
+    rbhash::map<uint64_t, uint64_t> tbl(10);
+    for (uint64_t i = 0; i < 64; ++i) {
+        EXPECT_TRUE(tbl.insert(i << 20, i));
+    }
+    EXPECT_NE(tbl.seed(), 0);
+    EXPECT_EQ(tbl.capacity(), 1 << 11);
+    EXPECT_NE(tbl.stat().find("\"nr_reseed\":1"), std::string::npos) << tbl.stat();
+    for (uint64_t i = 0; i < 64; ++i) {
+        EXPECT_EQ(tbl.find(i << 20), i);
+    }
+}
+
+TEST(Operation, FindBatch)
+{
+    IntIntTable tbl(4);
+    for (int i = 0; i < 1000; i += 2) {
+        EXPECT_TRUE(tbl.insert(i, i * 10));
+    }
+
+    constexpr size_t n = 150;
+    int keys[n];
+    int values[n];
+    uint64_t mask[(n + 63) / 64];
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = 3 * i;
+        values[i] = -1;
+    }
+    EXPECT_EQ(tbl.find_batch(keys, n, values, mask), n / 2);
+    for (size_t i = 0; i < n; ++i) {
+        const bool found = (mask[i / 64] >> (i % 64)) & 1;
+        EXPECT_EQ(found, keys[i] % 2 == 0) << i;
+        EXPECT_EQ(values[i], found ? keys[i] * 10 : -1) << i;
+    }
+
+    StringIntTable strtbl(4);
+    strtbl.insert("a", 1);
+    std::string strkeys[] = { "a", "b" };
+    int strvalues[2] = { 0, 0 };
+    EXPECT_EQ(strtbl.find_batch(strkeys, 2, strvalues, mask), 1);
+    EXPECT_EQ(mask[0], 1);
+    EXPECT_EQ(strvalues[0], 1);
+}
+
+TEST(Operation, InsertBulk)
+{
+    IntIntTable tbl(4);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_TRUE(tbl.insert(i, -i));
+    }
+
+    // 随机访问迭代器，与已有元素部分重叠
+    std::vector<std::pair<int, int>> data;
+    for (int i = 50; i < 50000; ++i) {
+        data.emplace_back(i, i);
+    }
+    EXPECT_EQ(tbl.insert_bulk(data.begin(), data.end()), 50000 - 100);
+    EXPECT_EQ(tbl.size(), 50000);
+    for (int i = 0; i < 50000; ++i) {
+        EXPECT_EQ(tbl.find(i), i < 100 ? -i : i) << i;
+    }
+
+    // 前向迭代器
+    std::map<int, int> ordered;
+    for (int i = 49990; i < 50010; ++i) {
+        ordered.emplace(i, 0);
+    }
+    EXPECT_EQ(tbl.insert_bulk(ordered.begin(), ordered.end()), 10);
+    EXPECT_EQ(tbl.size(), 50010);
+    EXPECT_EQ(tbl.find(50005), 0);
+    EXPECT_EQ(tbl.find(49995), 49995);
+
+    EXPECT_EQ(tbl.insert_bulk(data.end(), data.end()), 0);
+}
+
+TEST(Operation, UpsertBatch)
+{
+    IntIntTable tbl(1);
+    auto add = [](int& stored, const int& v) { stored += v; };
+
+    // 整批插入时预先一次性扩容
+    std::vector<std::pair<int, int>> batch;
+    for (int i = 0; i < 1000; ++i) {
+        batch.emplace_back(i, i);
+    }
+    batch.emplace_back(0, 100);
+    EXPECT_EQ(tbl.upsert_batch(batch.begin(), batch.end(), add), 1000);
+    EXPECT_EQ(tbl.size(), 1000);
+    EXPECT_EQ(tbl.capacity(), 1024);
+    EXPECT_EQ(tbl.find(0), 100);
+    for (int i = 1; i < 1000; ++i) {
+        EXPECT_EQ(tbl.find(i), i);
+    }
+
+    // 一半更新，一半插入
+    std::map<int, int> ordered;
+    for (int i = 500; i < 1500; ++i) {
+        ordered.emplace(i, 1);
+    }
+    EXPECT_EQ(tbl.upsert_batch(ordered.begin(), ordered.end(), add), 500);
+    EXPECT_EQ(tbl.size(), 1500);
+    for (int i = 0; i < 1500; ++i) {
+        EXPECT_EQ(tbl.find(i), i == 0 ? 100 : i < 500 ? i : i < 1000 ? i + 1 : 1) << i;
+    }
+}
+
+TEST(Operation, MultiUpdate)
+{
+    IntIntTable tbl(4);
+    for (int i = 0; i < 64; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+
+    // 交换两个key的value
+    EXPECT_EQ(tbl.multi_update_fn({ 1, 2 }, [](std::vector<int*>& v) { std::swap(*v[0], *v[1]); }), 2);
+    EXPECT_EQ(tbl.find(1), 2);
+    EXPECT_EQ(tbl.find(2), 1);
+
+    // 不存在的key对应nullptr
+    std::vector<int> keys { 3, 100, 4 };
+    EXPECT_EQ(tbl.multi_update_fn(keys.begin(), keys.end(), [](std::vector<int*>& v) {
+        EXPECT_NE(v[0], nullptr);
+        EXPECT_EQ(v[1], nullptr);
+        EXPECT_NE(v[2], nullptr);
+        *v[0] += *v[2];
+        *v[2] = 0;
+    }),
+        2);
+    EXPECT_EQ(tbl.find(3), 7);
+    EXPECT_EQ(tbl.find(4), 0);
+}
+
+TEST(MultiThreading, MultiUpdate)
+{
+    // 并发转账，总额保持不变
+    constexpr int kAccounts = 32;
+    constexpr int kBalance = 1000;
+    IntIntTable tbl(1);
+    for (int i = 0; i < kAccounts; ++i) {
+        EXPECT_TRUE(tbl.insert(i, kBalance));
+    }
+
+    std::atomic<bool> finished(false);
+    auto transfer = [&](int id) {
+        for (int i = 0; i < 5000; ++i) {
+            const int from = (i * 7 + id) % kAccounts;
+            const int to = (i * 13 + id + 1) % kAccounts;
+            tbl.multi_update_fn({ from, to }, [](std::vector<int*>& v) {
+                --*v[0];
+                ++*v[1];
+            });
+            if (i % 1000 == 0) {
+                // 并发扩容
+                tbl.insert(kAccounts + id * 5000 + i, 0);
+            }
+        }
+    };
+    auto audit = [&]() {
+        std::vector<int> keys;
+        for (int i = 0; i < kAccounts; ++i) {
+            keys.push_back(i);
+        }
+        while (!finished.load()) {
+            tbl.multi_update_fn(keys.begin(), keys.end(), [&](std::vector<int*>& v) {
+                int total = 0;
+                for (int* p : v) {
+                    total += *p;
+                }
+                EXPECT_EQ(total, kAccounts * kBalance);
+            });
+        }
+    };
+
+    std::thread auditor(audit);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; ++i) {
+        threads.emplace_back(transfer, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    finished.store(true);
+    auditor.join();
+
+    int total = 0;
+    for (int i = 0; i < kAccounts; ++i) {
+        total += tbl.find(i);
+    }
+    EXPECT_EQ(total, kAccounts * kBalance);
+}
+
+TEST(MultiThreading, UpsertBatch)
+{
+    IntIntTable tbl(1);
+    constexpr int kThreads = 4;
+    constexpr int kKeys = 2000;
+    constexpr int kRounds = 20;
+
+    // 所有线程对相同的key集合做累加，结果与加锁的逐个累加一致
+    auto worker = [&](int id) {
+        std::vector<std::pair<int, int>> batch;
+        for (int i = 0; i < kKeys; ++i) {
+            batch.emplace_back((i * 7 + id * 13) % kKeys, 1);
+        }
+        for (int r = 0; r < kRounds; ++r) {
+            tbl.upsert_batch(batch.begin(), batch.end(),
+                [](int& stored, const int& v) { stored += v; });
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back(worker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(tbl.size(), kKeys);
+    for (int i = 0; i < kKeys; ++i) {
+        EXPECT_EQ(tbl.find(i), kThreads * kRounds) << i;
+    }
+}
+
+TEST(MultiThreading, CollisionFlood)
+{
+    rbhash::map<uint64_t, uint64_t> tbl(4);
+    constexpr uint64_t present = 256;
+    constexpr uint64_t flood = 1 << 12;
+    for (uint64_t i = 0; i < present; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+
+    // 更换种子期间，并发的查找不能漏掉已有的元素
+    std::atomic<bool> finished(false);
+    auto reader = [&]() {
+        while (!finished.load()) {
+            for (uint64_t i = 0; i < present; ++i) {
+                uint64_t value = 0;
+                EXPECT_TRUE(tbl.find(i, value)) << i;
+                EXPECT_EQ(value, i);
+            }
+        }
+    };
+    auto writer = [&](uint64_t id) {
+        for (uint64_t i = id + 1; i < flood; i += 2) {
+            EXPECT_TRUE(tbl.insert(i << 20, i));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.emplace_back(reader);
+    threads.emplace_back(reader);
+    std::thread w0(writer, 0), w1(writer, 1);
+    w0.join();
+    w1.join();
+    finished.store(true);
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_NE(tbl.seed(), 0);
+    EXPECT_EQ(tbl.size(), present + flood - 1);
+    for (uint64_t i = 1; i < flood; ++i) {
+        EXPECT_EQ(tbl.find(i << 20), i);
+    }
+}
+
+TEST(MultiThreading, ExpandInPlace)
+{
+    constexpr uint64_t counter = 1 << 17;
+    constexpr uint64_t num_threads = 4;
+    rbhash::map<uint64_t, uint64_t> tbl(16);
+    auto insertWorker = [&](uint64_t id) {
+        for (uint64_t i = 0; i < counter; ++i) {
+            const uint64_t k = i * num_threads + id;
+            EXPECT_TRUE(tbl.insert(k, k));
+            EXPECT_EQ(tbl.find(k), k);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < num_threads; ++i) {
+        threads.emplace_back(insertWorker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(tbl.size(), counter * num_threads);
+    for (uint64_t k = 0; k < counter * num_threads; ++k) {
+        EXPECT_EQ(tbl.find(k), k);
+    }
+}
+
 TEST(MultiThreading, InsertFind)
 {
     rbhash::map<uint64_t, uint64_t> tbl(1);
@@ -348,6 +980,54 @@ TEST(StringTable, InsertDeleteFind)
     EXPECT_GE(tbl.capacity(), 2 * counter);
 }
 
+// 记录以const char*调用的次数，用于确认查找时没有构造临时的std::string
+struct CountingStringHash : rbhash::string_hash {
+    using rbhash::string_hash::operator();
+    size_t operator()(const char* s) const
+    {
+        ++char_calls;
+        return rbhash::string_hash::operator()(s);
+    }
+    static int char_calls;
+};
+int CountingStringHash::char_calls = 0;
+
+TEST(StringTable, TransparentLookup)
+{
+    rbhash::string_hash hasher;
+    EXPECT_EQ(hasher("hello"), hasher(std::string("hello")));
+    EXPECT_NE(hasher("hello"), hasher("hellp"));
+    EXPECT_NE(hasher(""), hasher(std::string(1, '\0')));
+
+    rbhash::map<std::string, int, CountingStringHash, rbhash::string_equal> tbl(4);
+    constexpr int size = 1000;
+    for (int i = 0; i < size; ++i) {
+        EXPECT_TRUE(tbl.insert(generateKey<std::string>(i), i));
+    }
+    const std::string long_key(100, 'x');
+    EXPECT_TRUE(tbl.insert(long_key, -1));
+
+    CountingStringHash::char_calls = 0;
+    for (int i = 0; i < size; ++i) {
+        const std::string key = generateKey<std::string>(i);
+        EXPECT_EQ(tbl.find(key.c_str()), i);
+    }
+    EXPECT_EQ(CountingStringHash::char_calls, size);
+    EXPECT_EQ(tbl.find(long_key.c_str()), -1);
+
+    int value = 0;
+    EXPECT_FALSE(tbl.find("missing", value));
+    EXPECT_TRUE(tbl.update_fn(long_key.c_str(), [](int& v) { v = 1; }));
+    EXPECT_TRUE(tbl.erase(long_key.c_str()));
+    EXPECT_FALSE(tbl.find(long_key, value));
+
+    // 不支持异构查找的哈希函数，查找时key只会被转换一次
+    StringIntTable plain(4);
+    EXPECT_TRUE(plain.insert("abc", 1));
+    EXPECT_EQ(plain.find("abc"), 1);
+    EXPECT_TRUE(plain.erase("abc"));
+}
+
 int main(int argc, char* argv[])
 {
     ::testing::InitGoogleTest(&argc, argv);
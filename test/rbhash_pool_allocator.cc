@@ -0,0 +1,124 @@
+#include "rbhash/pool_allocator.hpp"
+#include "rbhash/rbhash.hpp"
+#include "rbhash_test.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using PoolTable = rbhash::map<uint64_t, uint64_t, std::hash<uint64_t>,
+    std::equal_to<uint64_t>,
+    rbhash::pool_allocator<std::pair<const uint64_t, uint64_t>>>;
+
+TEST(PoolAllocator, SmallObjects)
+{
+    rbhash::pool_allocator<uint64_t> alloc;
+    std::vector<uint64_t*> ptrs;
+    for (int i = 0; i < 10000; ++i) {
+        uint64_t* p = alloc.allocate(1);
+        *p = i;
+        ptrs.push_back(p);
+    }
+    for (int i = 0; i < 10000; ++i) {
+        EXPECT_EQ(*ptrs[i], i);
+    }
+    for (auto p : ptrs) {
+        alloc.deallocate(p, 1);
+    }
+
+    // 释放的对象被同一个线程重新使用
+    uint64_t* p = alloc.allocate(1);
+    EXPECT_EQ(p, ptrs.back());
+    alloc.deallocate(p, 1);
+
+    // 对齐要求超过16字节的对象
+    rbhash::pool_allocator<rbhash::spinlock_t> lock_alloc;
+    rbhash::spinlock_t* l = lock_alloc.allocate(3);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(l) % 64, 0);
+    lock_alloc.deallocate(l, 3);
+}
+
+TEST(PoolAllocator, RecycledArrays)
+{
+    auto& pool = rbhash::pool_resource::instance();
+    pool.release();
+    EXPECT_EQ(pool.cached_bytes(), 0);
+    {
+        PoolTable tbl(10);
+        for (uint64_t i = 0; i < 1 << 14; ++i) {
+            EXPECT_TRUE(tbl.insert(i, i));
+        }
+        // 扩容释放的旧bucket数组进入回收缓存
+        EXPECT_GT(pool.cached_bytes(), 0);
+    }
+
+    // 相同大小的bucket数组直接复用
+    const std::string before = pool.stat();
+    {
+        PoolTable tbl(10);
+        for (uint64_t i = 0; i < 1 << 14; ++i) {
+            EXPECT_TRUE(tbl.insert(i, i));
+        }
+        for (uint64_t i = 0; i < 1 << 14; ++i) {
+            EXPECT_EQ(tbl.find(i), i);
+        }
+    }
+    const std::string after = pool.stat();
+    EXPECT_NE(before, after);
+    EXPECT_EQ(after.find("\"nr_array_hit\":0,"), std::string::npos) << after;
+
+    pool.max_cached_bytes(0);
+    EXPECT_EQ(pool.cached_bytes(), 0);
+    {
+        PoolTable tbl(12);
+        EXPECT_TRUE(tbl.insert(1, 1));
+    }
+    EXPECT_EQ(pool.cached_bytes(), 0);
+    pool.max_cached_bytes(size_t(256) << 20);
+}
+
+TEST(PoolAllocator, MultiThreading)
+{
+    // 一个线程申请、另一个线程释放，对象经过全局链表在线程之间流动
+    constexpr int count = 1 << 14;
+    std::vector<std::string*> ptrs(count);
+    rbhash::pool_allocator<std::string> alloc;
+    std::thread producer([&] {
+        for (int i = 0; i < count; ++i) {
+            ptrs[i] = alloc.allocate(1);
+            new (ptrs[i]) std::string(std::to_string(i));
+        }
+    });
+    producer.join();
+    std::thread consumer([&] {
+        for (int i = 0; i < count; ++i) {
+            EXPECT_EQ(*ptrs[i], std::to_string(i));
+            ptrs[i]->~basic_string();
+            alloc.deallocate(ptrs[i], 1);
+        }
+    });
+    consumer.join();
+
+    PoolTable tbl(1);
+    auto insertWorker = [&](uint64_t id) {
+        for (uint64_t i = 0; i < count; ++i) {
+            EXPECT_TRUE(tbl.insert(4 * i + id, i));
+        }
+    };
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < 4; ++i) {
+        threads.emplace_back(insertWorker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(tbl.size(), 4 * count);
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
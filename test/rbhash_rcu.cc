@@ -0,0 +1,170 @@
+#include "rbhash/rbhash.hpp"
+#include "rbhash/rcu_map.hpp"
+#include "rbhash_test.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using IntIntRcuTable = rbhash::rcu_map<int, int>;
+
+TEST(Rcu, Basic)
+{
+    IntIntRcuTable tbl(1);
+    EXPECT_TRUE(tbl.empty());
+
+    for (int i = 0; i < 256; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+    EXPECT_FALSE(tbl.insert(0, 1));
+    EXPECT_EQ(tbl.size(), 256);
+    EXPECT_LE(tbl.load_factor(), 0.5);
+
+    int value = 0;
+    for (int i = 0; i < 256; ++i) {
+        EXPECT_TRUE(tbl.find(i, value));
+        EXPECT_EQ(value, i);
+        EXPECT_EQ(tbl.find(i), i);
+    }
+    EXPECT_FALSE(tbl.contains(256));
+    EXPECT_THROW(tbl.find(256), std::out_of_range);
+
+    EXPECT_FALSE(tbl.insert_or_assign(1, 100));
+    EXPECT_EQ(tbl.find(1), 100);
+    EXPECT_TRUE(tbl.insert_or_assign(1000, 1000));
+    EXPECT_TRUE(tbl.erase(1000));
+    EXPECT_FALSE(tbl.erase(1000));
+    EXPECT_FALSE(tbl.contains(1000));
+    EXPECT_EQ(tbl.size(), 256);
+}
+
+TEST(Rcu, Batch)
+{
+    rbhash::rcu_map<std::string, int> tbl(4);
+    tbl.modify([](rbhash::rcu_map<std::string, int>::writer& w) {
+        for (int i = 0; i < 1024; ++i) {
+            EXPECT_TRUE(w.insert(generateKey<std::string>(i), i));
+        }
+        for (int i = 0; i < 1024; i += 2) {
+            EXPECT_TRUE(w.erase(generateKey<std::string>(i)));
+        }
+        EXPECT_TRUE(w.update_fn(generateKey<std::string>(1), [](int& v) { v = -1; }));
+        EXPECT_EQ(w.size(), 512);
+    });
+    EXPECT_EQ(tbl.size(), 512);
+    EXPECT_EQ(tbl.find(generateKey<std::string>(1)), -1);
+    for (int i = 3; i < 1024; i += 2) {
+        EXPECT_EQ(tbl.find(generateKey<std::string>(i)), i);
+    }
+    for (int i = 0; i < 1024; i += 2) {
+        EXPECT_FALSE(tbl.contains(generateKey<std::string>(i)));
+    }
+
+    // 回调中抛出异常时，当前版本保持不变
+    EXPECT_THROW(tbl.modify([](rbhash::rcu_map<std::string, int>::writer& w) {
+        w.insert(generateKey<std::string>(0), 0);
+        throw std::runtime_error("abort");
+    }),
+        std::runtime_error);
+    EXPECT_FALSE(tbl.contains(generateKey<std::string>(0)));
+}
+
+TEST(Rcu, ReadersAndWriter)
+{
+    IntIntRcuTable tbl(4);
+    constexpr int kKeys = 64;
+    constexpr int kRounds = 200;
+    tbl.modify([](IntIntRcuTable::writer& w) {
+        for (int i = 0; i < kKeys; ++i) {
+            w.insert(i, 0);
+        }
+    });
+
+    std::atomic<bool> finished(false);
+    auto reader = [&]() {
+        int last = 0;
+        while (!finished.load()) {
+            for (int i = 0; i < kKeys; ++i) {
+                int value = -1;
+                EXPECT_TRUE(tbl.find(i, value));
+                EXPECT_GE(value, 0);
+                EXPECT_LE(value, kRounds);
+            }
+            // 同一个线程看到的版本是单调的
+            int value = tbl.find(0);
+            EXPECT_GE(value, last);
+            last = value;
+        }
+    };
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back(reader);
+    }
+    for (int r = 1; r <= kRounds; ++r) {
+        tbl.modify([r](IntIntRcuTable::writer& w) {
+            for (int i = 0; i < kKeys; ++i) {
+                w.insert_or_assign(i, r);
+            }
+        });
+    }
+    finished.store(true);
+    for (auto& t : readers) {
+        t.join();
+    }
+
+    // 没有读者时，所有旧版本都可以被回收
+    tbl.reclaim();
+    const size_t bucket_bytes = tbl.bucket_count() * sizeof(IntIntRcuTable::buckets_t::bucket);
+    EXPECT_LT(tbl.footprint(), 2 * bucket_bytes + (1 << 16));
+    for (int i = 0; i < kKeys; ++i) {
+        EXPECT_EQ(tbl.find(i), kRounds);
+    }
+}
+
+TEST(Rcu, ReaderSlots)
+{
+    IntIntRcuTable tbl(4);
+    tbl.modify([](IntIntRcuTable::writer& w) {
+        for (int i = 0; i < 16; ++i) {
+            w.insert(i, i);
+        }
+    });
+
+    // 嵌套的读操作共用同一个读者槽
+    EXPECT_TRUE(tbl.find_fn(1, [&tbl](const int& v) {
+        EXPECT_EQ(v, 1);
+        EXPECT_EQ(tbl.size(), 16);
+        EXPECT_EQ(tbl.find(2), 2);
+    }));
+
+    // 退出的线程归还读者槽，之后的线程复用而不是注册新的
+    constexpr int kThreads = 16;
+    auto wave = [&tbl]() {
+        std::vector<std::thread> readers;
+        for (int t = 0; t < kThreads; ++t) {
+            readers.emplace_back([&tbl]() {
+                for (int i = 0; i < 16; ++i) {
+                    EXPECT_EQ(tbl.find(i), i);
+                }
+            });
+        }
+        for (auto& t : readers) {
+            t.join();
+        }
+    };
+    wave();
+    const size_t footprint = tbl.footprint();
+    for (int i = 0; i < 4; ++i) {
+        wave();
+    }
+    EXPECT_EQ(tbl.footprint(), footprint);
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,155 @@
+#include "rbhash/rbhash.hpp"
+#include "rbhash/set.hpp"
+#include "rbhash_test.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using IntSet = rbhash::set<uint64_t>;
+
+TEST(Set, Basic)
+{
+    IntSet s(1);
+    EXPECT_TRUE(s.empty());
+    for (uint64_t i = 0; i < 1024; ++i) {
+        EXPECT_TRUE(s.insert(i));
+        EXPECT_FALSE(s.insert(i));
+    }
+    EXPECT_EQ(s.size(), 1024);
+    EXPECT_GE(s.capacity(), 1024);
+    for (uint64_t i = 0; i < 2048; ++i) {
+        EXPECT_EQ(s.contains(i), i < 1024) << i;
+    }
+
+    for (uint64_t i = 0; i < 1024; i += 2) {
+        EXPECT_TRUE(s.erase(i));
+        EXPECT_FALSE(s.erase(i));
+    }
+    EXPECT_EQ(s.size(), 512);
+    EXPECT_FALSE(s.contains(0));
+    EXPECT_TRUE(s.contains(1));
+
+    const auto hv = s.hash_of(uint64_t(4096));
+    EXPECT_TRUE(s.insert(hv, uint64_t(4096)));
+    EXPECT_TRUE(s.contains(hv, uint64_t(4096)));
+    EXPECT_TRUE(s.erase(hv, uint64_t(4096)));
+
+    // bucket中不保存value，比map<uint64_t, bool>更小
+    using BoolMapBucket = rbhash::map<uint64_t, bool>::buckets_t::bucket;
+    EXPECT_LT(sizeof(IntSet::map_type::buckets_t::bucket), sizeof(BoolMapBucket));
+
+    s.clear();
+    EXPECT_TRUE(s.empty());
+    EXPECT_FALSE(s.contains(1));
+}
+
+TEST(Set, ContainsBatch)
+{
+    IntSet s(4);
+    for (uint64_t i = 0; i < 100; i += 3) {
+        EXPECT_TRUE(s.insert(i));
+    }
+    std::vector<uint64_t> keys;
+    for (uint64_t i = 0; i < 100; ++i) {
+        keys.push_back(i);
+    }
+    uint64_t mask[2];
+    EXPECT_EQ(s.contains_batch(keys.data(), keys.size(), mask), 34);
+    for (uint64_t i = 0; i < 100; ++i) {
+        EXPECT_EQ((mask[i / 64] >> (i % 64)) & 1, i % 3 == 0 ? 1 : 0) << i;
+    }
+}
+
+TEST(Set, StringKey)
+{
+    rbhash::set<std::string> s(2);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(s.insert(std::to_string(i)));
+    }
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(s.contains(std::to_string(i)));
+    }
+    EXPECT_FALSE(s.contains(std::string("abc")));
+    EXPECT_TRUE(s.erase(std::string("10")));
+    EXPECT_EQ(s.size(), 999);
+}
+
+TEST(Set, LockTable)
+{
+    IntSet s(4);
+    {
+        auto locked = s.lock_table();
+        EXPECT_TRUE(locked.begin() == locked.end());
+    }
+    constexpr uint64_t size = 1000;
+    for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_TRUE(s.insert(i));
+    }
+    {
+        auto locked = s.lock_table();
+        std::set<uint64_t> seen;
+        for (const auto& k : locked) {
+            EXPECT_TRUE(seen.insert(k).second);
+        }
+        EXPECT_EQ(seen.size(), size);
+
+        EXPECT_TRUE(locked.contains(uint64_t(10)));
+        EXPECT_FALSE(locked.insert(uint64_t(10)).second);
+        auto res = locked.insert(uint64_t(size));
+        EXPECT_TRUE(res.second);
+        EXPECT_EQ(*res.first, size);
+        EXPECT_EQ(locked.erase(uint64_t(size)), 1);
+
+        // 通过迭代器删除所有偶数
+        for (auto it = locked.begin(); it != locked.end();) {
+            if (*it % 2 == 0) {
+                it = locked.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    // 解锁之后可以继续操作
+    EXPECT_EQ(s.size(), size / 2);
+    EXPECT_FALSE(s.contains(10));
+    EXPECT_TRUE(s.contains(11));
+}
+
+TEST(Set, MultiThreading)
+{
+    IntSet s(1);
+    constexpr uint64_t counter = 1 << 14;
+    constexpr int num_threads = 4;
+    std::atomic<uint64_t> inserted(0);
+
+    // 所有线程插入相同的key集合，每个key只能被成功插入一次；期间会多次扩容
+    auto insertWorker = [&](int id) {
+        for (uint64_t i = 0; i < counter; ++i) {
+            const uint64_t key = (i + id * counter / num_threads) % counter;
+            if (s.insert(key)) {
+                inserted.fetch_add(1, std::memory_order_relaxed);
+            }
+            EXPECT_TRUE(s.contains(key)) << key;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(insertWorker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(inserted.load(), counter);
+    EXPECT_EQ(s.size(), counter);
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
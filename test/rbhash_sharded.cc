@@ -0,0 +1,190 @@
+#include "rbhash/rbhash.hpp"
+#include "rbhash/sharded_map.hpp"
+#include "rbhash_test.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using IntIntShardedTable = rbhash::sharded_map<int, int>;
+
+TEST(Sharded, Construct)
+{
+    IntIntShardedTable tbl(3, 10);
+    EXPECT_EQ(tbl.num_shards(), 4);
+    EXPECT_EQ(tbl.capacity(), 1 << 10);
+    EXPECT_TRUE(tbl.empty());
+
+    IntIntShardedTable tbl2;
+    EXPECT_EQ(tbl2.num_shards(), IntIntShardedTable::default_num_shards());
+}
+
+TEST(Sharded, Operation)
+{
+    IntIntShardedTable tbl(4, 2);
+    constexpr int size = 1 << 12;
+    for (int i = 0; i < size; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+    EXPECT_EQ(tbl.size(), size);
+
+    // 顺序的整数key也要分散到所有分片
+    for (size_t i = 0; i < tbl.num_shards(); ++i) {
+        EXPECT_GT(tbl.shard(i).size(), 0) << i;
+    }
+
+    int value = 0;
+    for (int i = 0; i < size; ++i) {
+        EXPECT_TRUE(tbl.find(i, value));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_TRUE(tbl.update(1, 100));
+    EXPECT_EQ(tbl.find(1), 100);
+    EXPECT_FALSE(tbl.insert_or_assign(2, 200));
+    EXPECT_EQ(tbl.find(2), 200);
+    tbl.upsert(3, [](int& v) { v = 300; }, 0);
+    EXPECT_EQ(tbl.find(3), 300);
+
+    for (int i = 0; i < size; i += 2) {
+        EXPECT_TRUE(tbl.erase(i));
+    }
+    EXPECT_EQ(tbl.size(), size / 2);
+    EXPECT_FALSE(tbl.find(0, value));
+    EXPECT_THROW(tbl.find(0), std::out_of_range);
+
+    tbl.clear();
+    EXPECT_TRUE(tbl.empty());
+}
+
+TEST(Sharded, PrecomputedHash)
+{
+    IntIntShardedTable tbl(4, 4);
+    for (int i = 0; i < 1000; ++i) {
+        const auto hv = tbl.hash_of(i);
+        EXPECT_EQ(tbl.shard_index(hv), tbl.shard_index(i));
+        EXPECT_TRUE(tbl.insert(hv, i, i));
+    }
+    int value = 0;
+    for (int i = 0; i < 1000; ++i) {
+        const auto hv = tbl.hash_of(i);
+        EXPECT_TRUE(tbl.find(hv, i, value));
+        EXPECT_EQ(value, i);
+        EXPECT_EQ(tbl.find(i), i);
+    }
+    const auto hv = tbl.hash_of(1);
+    EXPECT_FALSE(tbl.upsert(hv, 1, [](int& v) { v = 100; }, 0));
+    EXPECT_EQ(tbl.find(hv, 1), 100);
+    EXPECT_TRUE(tbl.update_fn(hv, 1, [](int& v) { ++v; }));
+    EXPECT_EQ(tbl.find(1), 101);
+    EXPECT_TRUE(tbl.erase(hv, 1));
+    EXPECT_FALSE(tbl.find(1, value));
+}
+
+TEST(Sharded, HashMixer)
+{
+    IntIntShardedTable tbl(4, 4);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(tbl.insert(i << 8, i));
+    }
+    // 切换混合策略后分片路由改变，元素迁移到新的分片
+    tbl.mixer(rbhash::hash_mixer::murmur);
+    EXPECT_EQ(tbl.mixer(), rbhash::hash_mixer::murmur);
+    EXPECT_EQ(tbl.size(), 1000);
+    for (size_t i = 0; i < tbl.num_shards(); ++i) {
+        EXPECT_EQ(tbl.shard(i).mixer(), rbhash::hash_mixer::murmur);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(tbl.find(i << 8), i);
+        EXPECT_EQ(tbl.shard(tbl.shard_index(i << 8)).find(i << 8), i);
+    }
+}
+
+TEST(Sharded, IndependentResize)
+{
+    IntIntShardedTable tbl(2, 2);
+    // 只向一个分片插入数据，只有该分片会扩容
+    int inserted = 0;
+    for (int i = 0; inserted < 1024; ++i) {
+        if (tbl.shard_index(i) == 0) {
+            EXPECT_TRUE(tbl.insert(i, i));
+            ++inserted;
+        }
+    }
+    EXPECT_GE(tbl.shard(0).capacity(), 1024);
+    EXPECT_EQ(tbl.shard(1).capacity(), 2);
+    EXPECT_EQ(tbl.shard(1).size(), 0);
+}
+
+TEST(Sharded, LockTable)
+{
+    IntIntShardedTable tbl(4, 4);
+    {
+        auto locked = tbl.lock_table();
+        EXPECT_TRUE(locked.begin() == locked.end());
+        EXPECT_TRUE(locked.cbegin() == locked.cend());
+    }
+
+    constexpr int size = 1000;
+    for (int i = 0; i < size; ++i) {
+        EXPECT_TRUE(tbl.insert(i, i));
+    }
+    {
+        auto locked = tbl.lock_table();
+        std::set<int> seen;
+        for (auto& p : locked) {
+            EXPECT_EQ(p.first, p.second);
+            p.second = -p.first;
+            EXPECT_TRUE(seen.insert(p.first).second);
+        }
+        EXPECT_EQ(seen.size(), size);
+
+        int counter = 0;
+        for (auto it = locked.cbegin(); it != locked.cend(); it++) {
+            EXPECT_EQ(it->second, -it->first);
+            ++counter;
+        }
+        EXPECT_EQ(counter, size);
+    }
+    // 解锁之后可以继续操作
+    EXPECT_EQ(tbl.find(10), -10);
+}
+
+TEST(Sharded, MultiThreading)
+{
+    rbhash::sharded_map<uint64_t, uint64_t> tbl(4, 1);
+    constexpr uint64_t counter = 1 << 12;
+
+    auto insertWorker = [&](uint64_t id) {
+        for (uint64_t i = 0; i < counter; ++i) {
+            EXPECT_TRUE(tbl.insert(4 * i + id, 4 * i + id));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < 4; ++i) {
+        threads.emplace_back(insertWorker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(tbl.size(), 4 * counter);
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < 4 * counter; ++i) {
+        EXPECT_TRUE(tbl.find(i, value)) << i;
+        EXPECT_EQ(value, i);
+    }
+
+    const std::string stat = tbl.stat();
+    EXPECT_NE(stat.find("\"num_shards\":4"), std::string::npos) << stat;
+    EXPECT_NE(stat.find("\"size\":" + std::to_string(4 * counter)), std::string::npos) << stat;
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
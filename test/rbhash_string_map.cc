@@ -0,0 +1,197 @@
+#include "rbhash/rbhash.hpp"
+#include "rbhash/string_map.hpp"
+#include "rbhash_test.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using StrMap = rbhash::string_map<int>;
+
+static std::string make_key(int i, size_t len)
+{
+    std::string key = std::to_string(i) + ":";
+    while (key.size() < len) {
+        key += static_cast<char>('a' + key.size() % 26);
+    }
+    return key;
+}
+
+TEST(StringMap, Basic)
+{
+    StrMap tbl(1);
+    EXPECT_TRUE(tbl.empty());
+    // 短key直接保存在slot中，不使用arena
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(tbl.insert(make_key(i, 8), i));
+        EXPECT_FALSE(tbl.insert(make_key(i, 8), -1));
+    }
+    EXPECT_EQ(tbl.size(), 1000);
+    EXPECT_EQ(tbl.arena_bytes(), 0);
+
+    // 长key保存在arena中
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(tbl.insert(make_key(i, 100), i));
+    }
+    EXPECT_EQ(tbl.size(), 2000);
+    EXPECT_EQ(tbl.arena_bytes(), 1000 * 100);
+
+    int value = 0;
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(tbl.find(make_key(i, 8), value));
+        EXPECT_EQ(value, i);
+        EXPECT_EQ(tbl.find(make_key(i, 100)), i);
+        EXPECT_TRUE(tbl.contains(make_key(i, 100).c_str()));
+        EXPECT_FALSE(tbl.contains(make_key(i, 99)));
+    }
+    EXPECT_FALSE(tbl.find(std::string("missing"), value));
+    EXPECT_THROW(tbl.find("missing"), std::out_of_range);
+
+    // 长度为0以及恰好等于inline_size()的key
+    EXPECT_TRUE(tbl.insert("", 7));
+    EXPECT_EQ(tbl.find(""), 7);
+    const std::string boundary(StrMap::inline_size(), 'x');
+    EXPECT_TRUE(tbl.insert(boundary, 8));
+    EXPECT_FALSE(tbl.contains(boundary + "x"));
+    EXPECT_EQ(tbl.find(boundary), 8);
+
+    EXPECT_TRUE(tbl.update(make_key(1, 100), 100));
+    EXPECT_EQ(tbl.find(make_key(1, 100)), 100);
+    EXPECT_FALSE(tbl.insert_or_assign(make_key(2, 8), 200));
+    EXPECT_EQ(tbl.find(make_key(2, 8)), 200);
+    EXPECT_FALSE(tbl.upsert(make_key(3, 8), [](int& v) { v *= 10; }, 0));
+    EXPECT_EQ(tbl.find(make_key(3, 8)), 30);
+}
+
+TEST(StringMap, Footprint)
+{
+    constexpr int size = 1 << 12;
+    StrMap tbl(12);
+    rbhash::map<std::string, int> strings(12);
+    for (int i = 0; i < size; ++i) {
+        tbl.insert(make_key(i, 12), i);
+        strings.insert(make_key(i, 12), i);
+    }
+    // 短key没有额外的堆分配，每个slot也比std::string的bucket小
+    EXPECT_LT(static_cast<double>(tbl.footprint()) / tbl.capacity(),
+        static_cast<double>(strings.footprint()) / strings.capacity());
+}
+
+TEST(StringMap, EraseAndCompact)
+{
+    StrMap tbl(4);
+    constexpr int size = 1 << 10;
+    for (int i = 0; i < size; ++i) {
+        EXPECT_TRUE(tbl.insert(make_key(i, 64), i));
+    }
+    for (int i = 0; i < size; ++i) {
+        if (i % 4 != 0) {
+            EXPECT_TRUE(tbl.erase(make_key(i, 64)));
+            EXPECT_FALSE(tbl.erase(make_key(i, 64)));
+        }
+    }
+    EXPECT_EQ(tbl.size(), size / 4);
+    const size_t used = tbl.arena_bytes();
+
+    // 扩容时压缩arena，只保留有效的长key
+    tbl.reserve(tbl.capacity() * 2);
+    EXPECT_EQ(tbl.arena_bytes(), used / 4);
+    for (int i = 0; i < size; ++i) {
+        EXPECT_EQ(tbl.contains(make_key(i, 64)), i % 4 == 0) << i;
+    }
+
+    std::map<std::string, int> seen;
+    tbl.for_each([&](const char* key, size_t len, int& v) {
+        seen.emplace(std::string(key, len), v);
+    });
+    EXPECT_EQ(seen.size(), size / 4);
+    EXPECT_EQ(seen[make_key(4, 64)], 4);
+
+    tbl.clear();
+    EXPECT_TRUE(tbl.empty());
+    EXPECT_EQ(tbl.arena_bytes(), 0);
+    EXPECT_FALSE(tbl.contains(make_key(0, 64)));
+    EXPECT_TRUE(tbl.insert(make_key(0, 64), 0));
+}
+
+TEST(StringMap, MultiThreading)
+{
+    rbhash::string_map<uint64_t> tbl(1);
+    constexpr int counter = 1 << 12;
+    constexpr int num_threads = 4;
+
+    // 每个线程插入互不相同的长key和短key，期间会多次扩容
+    auto insertWorker = [&](int id) {
+        for (int i = 0; i < counter; ++i) {
+            const int k = i * num_threads + id;
+            EXPECT_TRUE(tbl.insert(make_key(k, k % 2 ? 40 : 10), k));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(insertWorker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(tbl.size(), counter * num_threads);
+    for (int k = 0; k < counter * num_threads; ++k) {
+        EXPECT_EQ(tbl.find(make_key(k, k % 2 ? 40 : 10)), k);
+    }
+}
+
+TEST(StringMap, CompactingRebuild)
+{
+    // 只插入后删除的key会留下大量墓碑，探测过长时按照原容量重建；
+    // 与重建并发的查找和插入都不能错过已经存在的key
+    StrMap tbl(6);
+    constexpr int num_stable = 8;
+    constexpr int rounds = 1 << 16;
+    constexpr int num_threads = 4;
+    for (int i = 0; i < num_stable; ++i) {
+        EXPECT_TRUE(tbl.insert(make_key(i, i % 2 ? 40 : 10), i));
+    }
+
+    auto churnWorker = [&](int id) {
+        for (int i = 0; i < rounds; ++i) {
+            const std::string key = make_key((i + 1) * num_threads + id, 12);
+            EXPECT_TRUE(tbl.insert(key, i));
+            EXPECT_TRUE(tbl.erase(key));
+        }
+    };
+    auto stableWorker = [&](int id) {
+        for (int i = 0; i < rounds; ++i) {
+            const int k = (i + id) % num_stable;
+            const std::string key = make_key(k, k % 2 ? 40 : 10);
+            int value = -1;
+            EXPECT_TRUE(tbl.find(key, value)) << key;
+            EXPECT_EQ(value, k);
+            EXPECT_FALSE(tbl.insert(key, -1)) << key;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(churnWorker, i);
+        threads.emplace_back(stableWorker, i);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(tbl.size(), num_stable);
+    int count = 0;
+    tbl.for_each([&](const char*, size_t, int&) { ++count; });
+    EXPECT_EQ(count, num_stable);
+    // 墓碑通过原容量重建回收，容量没有随着插入次数增长
+    EXPECT_LT(tbl.capacity(), rounds);
+}
+
+int main(int argc, char* argv[])
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}